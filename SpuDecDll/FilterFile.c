@@ -0,0 +1,537 @@
+/*****************************************************************************
+ * FilterFile.c : filter file (skip/mute list) loading
+ *****************************************************************************
+ * Filter files are text, one entry per line:
+ *
+ *   DVD_Timescale                        <== optional first line
+ *   skip;00:38:35.000 --> 00:38:54.000
+ *   mute;01:24:05.000 --> 01:24:13.000;language
+ *   skipchapter;12                       <== chapter of the main movie
+ *   skipchapter;3.2                      <== title 3, chapter 2
+ *   skiptitle;5
+ *
+ * Any line can end with ;category[,category...] (see FilterCategories), so
+ * one file serves every profile; the profile picks which are used at load.
+ *
+ * Lines starting with discid; serial; or volume; are keys for the filter
+ * library (see FilterLibrary.c) and are skipped here.
+ *
+ * The file is memory mapped and parsed in place in a single pass; no streams
+ * or strings are created per line.
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "spudec.h"
+#include "FilterFile.h"
+
+/*****************************************************************************
+* helpers for walking through the mapped file
+*****************************************************************************/
+static inline const char *SkipBlanks(const char *p, const char *p_end)
+{
+	while ((p < p_end) && ((*p == ' ') || (*p == '\t')))
+	{
+		p++;
+	}
+	return p;
+}
+
+// reads at most i_max decimal digits, returns how many were read
+static inline int ReadDigits(const char **pp, const char *p_end, int i_max, unsigned int *pi_value)
+{
+	const char *p = *pp;
+	unsigned int value = 0;
+	int count = 0;
+
+	while ((p < p_end) && (count < i_max) && (*p >= '0') && (*p <= '9'))
+	{
+		value = (value * 10) + (*p - '0');
+		p++;
+		count++;
+	}
+	*pp = p;
+	*pi_value = value;
+	return count;
+}
+
+static inline bool MatchToken(const char **pp, const char *p_end, const char *psz_token, size_t i_len)
+{
+	if (((size_t)(p_end - *pp) < i_len) || (memcmp(*pp, psz_token, i_len) != 0))
+	{
+		return false;
+	}
+	*pp += i_len;
+	return true;
+}
+
+/*****************************************************************************
+* ParseFilterTime: hh:mm:ss.mmm (or srt style hh:mm:ss,mmm) to mtime
+* returns pointer past the time, or NULL if not a valid time
+*****************************************************************************/
+static const char *ParseFilterTime(const char *p, const char *p_end, mtime_t *pi_time)
+{
+	unsigned int hours, minutes, seconds;
+	unsigned int milliseconds = 0;
+	int i_digits;
+
+	if ((ReadDigits(&p, p_end, 3, &hours) == 0) || (p >= p_end) || (*p++ != ':'))
+		return NULL;
+	if ((ReadDigits(&p, p_end, 2, &minutes) != 2) || (minutes > 59) || (p >= p_end) || (*p++ != ':'))
+		return NULL;
+	if ((ReadDigits(&p, p_end, 2, &seconds) != 2) || (seconds > 59))
+		return NULL;
+	if ((p < p_end) && ((*p == '.') || (*p == ',')))
+	{
+		p++;
+		i_digits = ReadDigits(&p, p_end, 3, &milliseconds);
+		if (i_digits == 0)
+			return NULL;
+		// .5 is 500ms
+		for (; i_digits < 3; i_digits++)
+		{
+			milliseconds *= 10;
+		}
+	}
+	*pi_time = ((((((mtime_t)hours * 60) + minutes) * 60) + seconds) * 1000 + milliseconds) * 1000;
+	return p;
+}
+
+/*****************************************************************************
+* categories
+*****************************************************************************/
+static const struct
+{
+	const char *psz_name;
+	uint32_t i_bit;
+} FilterCategories[] =
+{
+	{ "language", FILTER_CAT_LANGUAGE },
+	{ "violence", FILTER_CAT_VIOLENCE },
+	{ "sex",      FILTER_CAT_SEX },
+	{ "nudity",   FILTER_CAT_NUDITY },
+	{ "drugs",    FILTER_CAT_DRUGS },
+	{ "gore",     FILTER_CAT_GORE },
+	{ "scary",    FILTER_CAT_SCARY },
+	{ "crude",    FILTER_CAT_CRUDE },
+	{ "other",    FILTER_CAT_OTHER },
+};
+
+// case insensitive, 0 if not known
+static uint32_t FindCategory(const char *p, size_t i_len)
+{
+	for (size_t i = 0; i < ARRAYSIZE(FilterCategories); i++)
+	{
+		const char *psz_name = FilterCategories[i].psz_name;
+		if ((strlen(psz_name) == i_len) && (_strnicmp(psz_name, p, i_len) == 0))
+			return FilterCategories[i].i_bit;
+	}
+	return 0;
+}
+
+// optional ;tag,tag... at the end of a line; returns pointer past them
+static const char *ParseCategories(const char *p, const char *p_end, uint32_t *pi_categories)
+{
+	const char *p_tag;
+
+	p = SkipBlanks(p, p_end);
+	if (!MatchToken(&p, p_end, ";", 1))
+		return p;
+	do
+	{
+		p_tag = p = SkipBlanks(p, p_end);
+		while ((p < p_end) && (*p != ',') && (*p != ' ') && (*p != '\t'))
+			p++;
+		if (p > p_tag)
+		{
+			// tags from newer files still count as something to filter
+			uint32_t i_bit = FindCategory(p_tag, p - p_tag);
+			*pi_categories |= (i_bit != 0) ? i_bit : FILTER_CAT_OTHER;
+		}
+		p = SkipBlanks(p, p_end);
+	} while (MatchToken(&p, p_end, ",", 1));
+	return p;
+}
+
+/*****************************************************************************
+* ParseNavLine: rest of a skipchapter;[title.]chapter or skiptitle;title line
+*****************************************************************************/
+static const char *ParseNavLine(const char *p, const char *p_end, FilterFileEntry *p_entry)
+{
+	unsigned int value, second;
+
+	p = SkipBlanks(p, p_end);
+	if (!MatchToken(&p, p_end, ";", 1))
+		return "missing ';' after filter type";
+
+	p = SkipBlanks(p, p_end);
+	if ((ReadDigits(&p, p_end, 3, &value) == 0) || (value == 0))
+		return (p_entry->FilterType == FILTER_SKIP_TITLE) ? "bad title number" : "bad chapter number";
+
+	if (p_entry->FilterType == FILTER_SKIP_TITLE)
+	{
+		p_entry->i_title = (int)value;
+	}
+	else if (MatchToken(&p, p_end, ".", 1))
+	{
+		if ((ReadDigits(&p, p_end, 3, &second) == 0) || (second == 0))
+			return "bad chapter number";
+		p_entry->i_title = (int)value;
+		p_entry->i_chapter = (int)second;
+	}
+	else
+	{
+		p_entry->i_chapter = (int)value;
+	}
+
+	p = ParseCategories(p, p_end, &p_entry->i_categories);
+	if (SkipBlanks(p, p_end) != p_end)
+		return "unexpected text after number";
+	return NULL;
+}
+
+/*****************************************************************************
+* ParseFilterLine: one entry, p_end is end of line (without the cr/lf)
+* returns NULL if ok, else the reason it failed
+*****************************************************************************/
+static const char *ParseFilterLine(const char *p, const char *p_end, FilterFileEntry *p_entry)
+{
+	p_entry->starttime = 0;
+	p_entry->endtime = 0;
+	p_entry->i_title = 0;
+	p_entry->i_chapter = 0;
+	p_entry->i_categories = 0;
+
+	p = SkipBlanks(p, p_end);
+	// longer names first, "skip" would match the start of them
+	if (MatchToken(&p, p_end, "skipchapter", 11))
+	{
+		p_entry->FilterType = FILTER_SKIP_CHAPTER;
+		return ParseNavLine(p, p_end, p_entry);
+	}
+	if (MatchToken(&p, p_end, "skiptitle", 9))
+	{
+		p_entry->FilterType = FILTER_SKIP_TITLE;
+		return ParseNavLine(p, p_end, p_entry);
+	}
+	if (MatchToken(&p, p_end, "mute", 4))
+		p_entry->FilterType = FILTER_MUTE;
+	else if (MatchToken(&p, p_end, "skip", 4))
+		p_entry->FilterType = FILTER_SKIP;
+	else
+		return "unknown filter type";
+
+	p = SkipBlanks(p, p_end);
+	if (!MatchToken(&p, p_end, ";", 1))
+		return "missing ';' after filter type";
+
+	p = ParseFilterTime(SkipBlanks(p, p_end), p_end, &p_entry->starttime);
+	if (p == NULL)
+		return "bad start time";
+
+	p = SkipBlanks(p, p_end);
+	if (!MatchToken(&p, p_end, "-->", 3))
+		return "missing '-->' between times";
+
+	p = ParseFilterTime(SkipBlanks(p, p_end), p_end, &p_entry->endtime);
+	if (p == NULL)
+		return "bad end time";
+
+	p = ParseCategories(p, p_end, &p_entry->i_categories);
+	if (SkipBlanks(p, p_end) != p_end)
+		return "unexpected text after end time";
+	if (p_entry->endtime <= p_entry->starttime)
+		return "end time is not after start time";
+
+	return NULL;
+}
+
+/*****************************************************************************
+* FilterFileMap: map whole file read only
+*****************************************************************************/
+int FilterFileMap(const wchar_t *psz_filename, filter_file_map_t *p_map)
+{
+	LARGE_INTEGER file_size;
+
+	p_map->h_mapping = NULL;
+	p_map->p_data = NULL;
+	p_map->i_size = 0;
+
+	p_map->h_file = CreateFileW(psz_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (p_map->h_file == INVALID_HANDLE_VALUE)
+	{
+		return VLC_EGENERIC;
+	}
+	if (!GetFileSizeEx(p_map->h_file, &file_size) || (file_size.QuadPart > INT32_MAX))
+	{
+		CloseHandle(p_map->h_file);
+		return VLC_EGENERIC;
+	}
+	// can't map an empty file, but it's a valid (empty) filter file
+	if (file_size.QuadPart > 0)
+	{
+		p_map->h_mapping = CreateFileMappingW(p_map->h_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (p_map->h_mapping != NULL)
+		{
+			p_map->p_data = (const char *)MapViewOfFile(p_map->h_mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (p_map->p_data == NULL)
+		{
+			if (p_map->h_mapping != NULL)
+				CloseHandle(p_map->h_mapping);
+			CloseHandle(p_map->h_file);
+			return VLC_EGENERIC;
+		}
+	}
+	p_map->i_size = (size_t)file_size.QuadPart;
+	return VLC_SUCCESS;
+}
+
+void FilterFileUnmap(filter_file_map_t *p_map)
+{
+	if (p_map->p_data != NULL)
+	{
+		UnmapViewOfFile(p_map->p_data);
+		CloseHandle(p_map->h_mapping);
+	}
+	CloseHandle(p_map->h_file);
+}
+
+// library keys (see FilterLibrary.c), nothing to do with the entries themselves
+static bool IsKeyLine(const char *p, const char *p_end)
+{
+	p = SkipBlanks(p, p_end);
+	return MatchToken(&p, p_end, "discid;", 7) || MatchToken(&p, p_end, "serial;", 7) || MatchToken(&p, p_end, "volume;", 7);
+}
+
+int FilterFileParseBuffer(vlc_object_t *p_obj, const wchar_t *psz_name, const char *p_data, size_t i_size, std::vector<FilterFileEntry> &entries, bool *pb_dvd_timescale)
+{
+	const char *p, *p_end, *p_eol, *p_line_end;
+	const char *psz_error;
+	unsigned int i_line = 0;
+	unsigned int i_errors = 0;
+	size_t i_first = entries.size();
+	FilterFileEntry entry;
+	mtime_t start_time = mdate();
+
+	*pb_dvd_timescale = false;
+
+	p = p_data;
+	p_end = p_data + i_size;
+	// utf-8 bom, if saved by notepad
+	if ((p_end - p >= 3) && (memcmp(p, "\xEF\xBB\xBF", 3) == 0))
+	{
+		p += 3;
+	}
+	// guess at number of entries, saves regrowing the array for big files
+	entries.reserve(i_first + (p_end - p) / 32 + 1);
+
+	for (; p < p_end; p = p_eol + 1)
+	{
+		i_line++;
+		p_eol = (const char *)memchr(p, '\n', p_end - p);
+		if (p_eol == NULL)
+			p_eol = p_end;
+		p_line_end = p_eol;
+		if ((p_line_end > p) && (p_line_end[-1] == '\r'))
+			p_line_end--;
+
+		// blank lines are fine
+		if ((SkipBlanks(p, p_line_end) == p_line_end) || IsKeyLine(p, p_line_end))
+			continue;
+
+		// first line either ignore or use to define using DVD time scale for timestamps
+		if (i_line == 1)
+		{
+			const char *p_word = SkipBlanks(p, p_line_end);
+			if (MatchToken(&p_word, p_line_end, "DVD_Timescale", 13) && (SkipBlanks(p_word, p_line_end) == p_line_end))
+			{
+				*pb_dvd_timescale = true;
+				continue;
+			}
+		}
+
+		psz_error = ParseFilterLine(p, p_line_end, &entry);
+		if (psz_error != NULL)
+		{
+			// first line used to be ignored, so don't complain about a title or such there
+			if (i_line > 1)
+			{
+				msg_Warn(p_obj, "%S:%u: %s, line ignored: %.*s\n", psz_name, i_line, psz_error, (int)__MIN(p_line_end - p, 80), p);
+				i_errors++;
+			}
+			continue;
+		}
+		entries.push_back(entry);
+	}
+
+	msg_Dbg(p_obj, "filter file: %u lines, %u entries, %u errors, parsed in %lld us\n", i_line, (unsigned int)(entries.size() - i_first), i_errors, mdate() - start_time);
+	return VLC_SUCCESS;
+}
+
+int FilterFileParse(vlc_object_t *p_obj, const wchar_t *psz_filename, std::vector<FilterFileEntry> &entries, bool *pb_dvd_timescale)
+{
+	filter_file_map_t map;
+
+	*pb_dvd_timescale = false;
+	if (FilterFileMap(psz_filename, &map) != VLC_SUCCESS)
+	{
+		return VLC_EGENERIC;
+	}
+	FilterFileParseBuffer(p_obj, psz_filename, map.p_data, map.i_size, entries, pb_dvd_timescale);
+	FilterFileUnmap(&map);
+	return VLC_SUCCESS;
+}
+
+static bool sortByStart(const FilterFileEntry &lhs, const FilterFileEntry &rhs) { return lhs.starttime < rhs.starttime; }
+static bool sortByTypeStart(const FilterFileEntry &lhs, const FilterFileEntry &rhs)
+{
+	if (lhs.FilterType != rhs.FilterType)
+		return lhs.FilterType < rhs.FilterType;
+	return lhs.starttime < rhs.starttime;
+}
+
+/*****************************************************************************
+* FilterProfileParse, FilterFileApplyProfile: which categories to filter,
+* and whether each one mutes or skips
+*****************************************************************************/
+void FilterProfileParse(vlc_object_t *p_obj, const char *psz_profile, filter_profile_t *p_profile)
+{
+	const char *p = psz_profile;
+	const char *p_end = p + ((p != NULL) ? strlen(p) : 0);
+
+	p_profile->i_active = 0;
+	p_profile->i_mute = 0;
+	p_profile->i_skip = 0;
+
+	while (p < p_end)
+	{
+		const char *p_name = p = SkipBlanks(p, p_end);
+		while ((p < p_end) && (*p != ',') && (*p != '=') && (*p != ' '))
+			p++;
+		const char *p_name_end = p;
+		uint32_t i_bit = ((p_name_end - p_name == 3) && (_strnicmp(p_name, "all", 3) == 0)) ? FILTER_CAT_ALL : FindCategory(p_name, p_name_end - p_name);
+
+		p = SkipBlanks(p, p_end);
+		if (MatchToken(&p, p_end, "=", 1))
+		{
+			p = SkipBlanks(p, p_end);
+			if (MatchToken(&p, p_end, "mute", 4))
+				p_profile->i_mute |= i_bit;
+			else if (MatchToken(&p, p_end, "skip", 4))
+				p_profile->i_skip |= i_bit;
+			else
+				msg_Warn(p_obj, "filter profile: expected mute or skip after %.*s=\n", (int)(p_name_end - p_name), p_name);
+		}
+		if ((i_bit == 0) && (p_name_end > p_name))
+			msg_Warn(p_obj, "filter profile: unknown category %.*s\n", (int)(p_name_end - p_name), p_name);
+		p_profile->i_active |= i_bit;
+
+		// on to the next one
+		while ((p < p_end) && (*p != ','))
+			p++;
+		if (p < p_end)
+			p++;
+	}
+	// nothing given: filter everything, as the file says
+	if (p_profile->i_active == 0)
+		p_profile->i_active = FILTER_CAT_ALL;
+}
+
+void FilterFileApplyProfile(vlc_object_t *p_obj, std::vector<FilterFileEntry> &entries, const filter_profile_t *p_profile)
+{
+	size_t i_before = entries.size();
+	unsigned int i_changed = 0;
+
+	auto inactive = [p_profile](const FilterFileEntry &n)
+	{
+		return (n.i_categories != 0) && ((n.i_categories & p_profile->i_active) == 0);
+	};
+	entries.erase(std::remove_if(entries.begin(), entries.end(), inactive), entries.end());
+
+	// a skip for any of its categories wins over a mute; chapter & title skips can't be muted
+	for (FilterFileEntry &n : entries)
+	{
+		uint32_t i_active = n.i_categories & p_profile->i_active;
+		if ((n.FilterType == FILTER_MUTE) && (i_active & p_profile->i_skip))
+		{
+			n.FilterType = FILTER_SKIP;
+			i_changed++;
+		}
+		else if ((n.FilterType == FILTER_SKIP) && (i_active & p_profile->i_mute) && !(i_active & p_profile->i_skip))
+		{
+			n.FilterType = FILTER_MUTE;
+			i_changed++;
+		}
+	}
+	msg_Info(p_obj, "Filter profile: %u of %u entries used, %u changed between mute & skip\n",
+		(unsigned int)entries.size(), (unsigned int)i_before, i_changed);
+}
+
+/*****************************************************************************
+* FilterFileNormalize: clean up entries after loading
+*****************************************************************************
+* Every skip is a seek, with a visible stall, so 2 skips that overlap or are
+* back to back should be a single seek.  Likewise a mute inside a skip is
+* never heard, no point in handshaking it with the audio decoder.
+*****************************************************************************/
+void FilterFileNormalize(vlc_object_t *p_obj, std::vector<FilterFileEntry> &entries, mtime_t i_merge_gap, mtime_t i_pre_pad, mtime_t i_post_pad)
+{
+	std::vector<FilterFileEntry> skips;
+	size_t i_before = entries.size();
+	size_t i_out = 0;
+	unsigned int i_merged = 0;
+	unsigned int i_covered = 0;
+
+	for (FilterFileEntry &n : entries)
+	{
+		n.starttime = __MAX(n.starttime - i_pre_pad, 0);
+		n.endtime += i_post_pad;
+	}
+
+	// group by type, so each type can be merged in one pass
+	std::sort(entries.begin(), entries.end(), sortByTypeStart);
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if ((i_out > 0) && (entries[i_out - 1].FilterType == entries[i].FilterType) && (entries[i].starttime <= entries[i_out - 1].endtime + i_merge_gap))
+		{
+			entries[i_out - 1].endtime = __MAX(entries[i_out - 1].endtime, entries[i].endtime);
+			entries[i_out - 1].i_categories |= entries[i].i_categories;
+			i_merged++;
+		}
+		else
+		{
+			entries[i_out++] = entries[i];
+		}
+	}
+	entries.resize(i_out);
+
+	// skips are now sorted and don't overlap, so last skip starting before a mute is the only one that can cover it
+	for (FilterFileEntry &n : entries)
+	{
+		if (n.FilterType == FILTER_SKIP)
+			skips.push_back(n);
+	}
+	if (!skips.empty())
+	{
+		auto covered = [&skips](const FilterFileEntry &n)
+		{
+			if (n.FilterType != FILTER_MUTE)
+				return false;
+			auto next = std::upper_bound(skips.begin(), skips.end(), n, sortByStart);
+			return (next != skips.begin()) && ((next - 1)->endtime >= n.endtime);
+		};
+		auto new_end = std::remove_if(entries.begin(), entries.end(), covered);
+		i_covered = (unsigned int)(entries.end() - new_end);
+		entries.erase(new_end, entries.end());
+	}
+
+	// sort the list by start time
+	std::sort(entries.begin(), entries.end(), sortByStart);
+
+	msg_Info(p_obj, "Filter entries: %u loaded, %u after normalizing (%u merged, %u mutes inside skips dropped)\n",
+		(unsigned int)i_before, (unsigned int)entries.size(), i_merged, i_covered);
+}
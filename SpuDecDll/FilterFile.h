@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * FilterFile.h : filter file (skip/mute list) loading
+ *****************************************************************************/
+
+#ifndef FILTERFILE_H
+#define FILTERFILE_H
+
+typedef enum
+{
+	FILTER_MUTE,
+	FILTER_SKIP,
+	FILTER_BLUR,
+	FILTER_SKIP_CHAPTER,  // whole chapter, done by navigation rather than time
+	FILTER_SKIP_TITLE,
+} FilterType_t;
+
+// category tags on an entry (bit each); entries without any are always used
+#define FILTER_CAT_LANGUAGE  0x0001
+#define FILTER_CAT_VIOLENCE  0x0002
+#define FILTER_CAT_SEX       0x0004
+#define FILTER_CAT_NUDITY    0x0008
+#define FILTER_CAT_DRUGS     0x0010
+#define FILTER_CAT_GORE      0x0020
+#define FILTER_CAT_SCARY     0x0040
+#define FILTER_CAT_CRUDE     0x0080
+#define FILTER_CAT_OTHER     0x8000  // any tag not known
+#define FILTER_CAT_ALL       0xFFFF
+
+// which categories to filter, & ones whose entries are always muted or always skipped whatever the file says
+typedef struct
+{
+	uint32_t i_active;
+	uint32_t i_mute;
+	uint32_t i_skip;
+} filter_profile_t;
+
+// plain old data, so the whole list is one contiguous array with no per entry allocations
+typedef struct
+{
+	mtime_t starttime;
+	mtime_t endtime;
+	FilterType_t FilterType;
+	// skipchapter/skiptitle only (times are 0): title (0 = main movie) & chapter, numbered from 1 as on the disc
+	int i_title;
+	int i_chapter;
+	uint32_t i_categories;  // FILTER_CAT_ bits, 0 if untagged
+} FilterFileEntry;
+
+// read only mapping of a whole file
+typedef struct
+{
+	HANDLE h_file;
+	HANDLE h_mapping;
+	const char *p_data;  // NULL for an empty file
+	size_t i_size;
+} filter_file_map_t;
+
+int FilterFileMap(const wchar_t *psz_filename, filter_file_map_t *p_map);
+void FilterFileUnmap(filter_file_map_t *p_map);
+
+// same as FilterFileParse, for a filter file already in memory; psz_name is only for messages
+int FilterFileParseBuffer(vlc_object_t *p_obj, const wchar_t *psz_name, const char *p_data, size_t i_size, std::vector<FilterFileEntry> &entries, bool *pb_dvd_timescale);
+
+// parse filter file into entries (appended, not sorted)
+// first line of "DVD_Timescale" sets *pb_dvd_timescale, any line that can't be parsed is logged with its line number and skipped
+// returns VLC_EGENERIC if the file couldn't be opened
+int FilterFileParse(vlc_object_t *p_obj, const wchar_t *psz_filename, std::vector<FilterFileEntry> &entries, bool *pb_dvd_timescale);
+
+// profile option, eg. "violence=skip,language=mute,sex" (a category on its own keeps the file's choice), "" or "all" for everything
+// unknown names are logged & ignored
+void FilterProfileParse(vlc_object_t *p_obj, const char *psz_profile, filter_profile_t *p_profile);
+
+// drop entries none of whose categories are active & apply the mute/skip overrides
+void FilterFileApplyProfile(vlc_object_t *p_obj, std::vector<FilterFileEntry> &entries, const filter_profile_t *p_profile);
+
+// pad all entries (time based only, chapter & title skips must be taken out first), merge ones of the same type that overlap or are within i_merge_gap of each other,
+// drop mutes that are entirely inside a skip, then sort by start time
+void FilterFileNormalize(vlc_object_t *p_obj, std::vector<FilterFileEntry> &entries, mtime_t i_merge_gap, mtime_t i_pre_pad, mtime_t i_post_pad);
+
+// content based disc id from the IFO files under psz_root (eg. L"D:\\"), 0 if there's no VIDEO_TS folder
+uint64_t DiscIdCompute(const wchar_t *psz_root);
+
+// find & parse filter file for the disc from the library built out of the psz_dir folder (rebuilt if the folder changed)
+// i_disc_id, i_serial of 0 or psz_volume of NULL are not used for the lookup
+// returns VLC_EGENERIC if no filter file matches
+int FilterLibraryLoad(vlc_object_t *p_obj, const wchar_t *psz_dir, uint64_t i_disc_id, uint32_t i_serial, const wchar_t *psz_volume, std::vector<FilterFileEntry> &entries, bool *pb_dvd_timescale);
+
+// cheap check for probing: does the library, as last built, have a filter file for psz_volume; nothing is rebuilt or parsed
+bool FilterLibraryHas(const wchar_t *psz_dir, const wchar_t *psz_volume);
+
+#endif
@@ -0,0 +1,424 @@
+/*****************************************************************************
+ * FilterLibrary.c : disc identification & packed filter file library
+ *****************************************************************************
+ * Volume names of older discs are often useless (eg. "DVD_VIDEO"), so discs
+ * are also identified by a hash of their IFO files, in the spirit of dvdid.
+ *
+ * All filter files in FilterFiles\ are packed into FilterFiles.bin:
+ *
+ *   header | hash table of keys | filter files, back to back
+ *
+ * Each filter file gets a key for its file name (the volume name), plus one
+ * for each of these lines in it:
+ *
+ *   discid;<16 hex digits, as logged when the disc is opened>
+ *   serial;<8 hex digits>
+ *   volume;<volume name>
+ *
+ * Finding the filter file for a disc is then a few probes into the mapped
+ * table, no matter how many files are in the library.  The library is
+ * rebuilt when any filter file is added, removed, renamed or edited: the
+ * header keeps a stamp of every file's name, size & last write time, which
+ * is checked against a listing of the folder (no file is read for that).
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "spudec.h"
+#include "FilterFile.h"
+
+#define LIBRARY_MAGIC "MFLB"
+#define LIBRARY_VERSION 2
+
+// how much of the main IFOs goes into the disc id; covers the tables that describe the titles
+#define DISCID_READ_SIZE 65536
+
+typedef struct
+{
+	char     magic[4];
+	uint32_t i_version;
+	uint32_t i_buckets;       // power of 2
+	uint32_t i_files;
+	uint64_t i_source_stamp;  // of the filter files the library was built from, see LibrarySourceStamp
+} library_header_t;
+
+typedef struct
+{
+	uint64_t i_key;           // 0 is an empty slot
+	uint32_t i_offset;        // from start of library file
+	uint32_t i_size;
+} library_slot_t;
+
+/*****************************************************************************
+* hashing, FNV-1a
+*****************************************************************************/
+#define LIBRARY_HASH_INIT UINT64_C(0xcbf29ce484222325)
+static inline uint64_t HashBytes(uint64_t i_hash, const void *p_data, size_t i_size)
+{
+	const uint8_t *p = (const uint8_t *)p_data;
+
+	for (size_t i = 0; i < i_size; i++)
+	{
+		i_hash ^= p[i];
+		i_hash *= UINT64_C(0x100000001b3);
+	}
+	return i_hash;
+}
+
+// key type ('D'isc id, 'S'erial, 'V'olume) + text, case insensitive since these get typed in by hand
+static uint64_t LibraryKey(char type, const wchar_t *psz_text, size_t i_len)
+{
+	uint64_t i_hash = HashBytes(LIBRARY_HASH_INIT, &type, 1);
+
+	for (size_t i = 0; i < i_len; i++)
+	{
+		wchar_t c = towupper(psz_text[i]);
+		i_hash = HashBytes(i_hash, &c, sizeof(c));
+	}
+	return (i_hash != 0) ? i_hash : 1;
+}
+
+static uint64_t HashFileStart(uint64_t i_hash, const std::wstring &filename)
+{
+	std::vector<uint8_t> buffer(DISCID_READ_SIZE);
+	DWORD i_read = 0;
+	HANDLE h_file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+
+	if (h_file == INVALID_HANDLE_VALUE)
+	{
+		return i_hash;
+	}
+	if (ReadFile(h_file, buffer.data(), DISCID_READ_SIZE, &i_read, NULL))
+	{
+		i_hash = HashBytes(i_hash, buffer.data(), i_read);
+	}
+	CloseHandle(h_file);
+	return i_hash;
+}
+
+/*****************************************************************************
+* DiscIdCompute: hash of names & sizes of all IFOs, plus start of the main ones
+*****************************************************************************/
+uint64_t DiscIdCompute(const wchar_t *psz_root)
+{
+	std::wstring dir = std::wstring(psz_root) + L"VIDEO_TS\\";
+	std::vector<std::pair<std::wstring, uint64_t>> files;
+	WIN32_FIND_DATAW find;
+	HANDLE h_find;
+	uint64_t i_hash = LIBRARY_HASH_INIT;
+
+	h_find = FindFirstFileW((dir + L"*.IFO").c_str(), &find);
+	if (h_find == INVALID_HANDLE_VALUE)
+	{
+		return 0;
+	}
+	do
+	{
+		std::wstring name = find.cFileName;
+		std::transform(name.begin(), name.end(), name.begin(), towupper);
+		files.push_back({ name, ((uint64_t)find.nFileSizeHigh << 32) | find.nFileSizeLow });
+	} while (FindNextFileW(h_find, &find));
+	FindClose(h_find);
+
+	// directory order isn't guaranteed
+	std::sort(files.begin(), files.end());
+	for (auto &file : files)
+	{
+		i_hash = HashBytes(i_hash, file.first.c_str(), file.first.size() * sizeof(wchar_t));
+		i_hash = HashBytes(i_hash, &file.second, sizeof(file.second));
+	}
+	i_hash = HashFileStart(i_hash, dir + L"VIDEO_TS.IFO");
+	i_hash = HashFileStart(i_hash, dir + L"VTS_01_0.IFO");
+
+	return (i_hash != 0) ? i_hash : 1;
+}
+
+/*****************************************************************************
+* library build
+*****************************************************************************/
+// hash of each filter file's name, size & last write time, added up so directory order doesn't matter;
+// editing a file in place changes its time but not the folder's, so the folder time alone isn't enough
+static uint64_t LibrarySourceStamp(const std::wstring &dir)
+{
+	WIN32_FIND_DATAW find;
+	HANDLE h_find;
+	uint64_t i_stamp = LIBRARY_HASH_INIT;
+
+	h_find = FindFirstFileW((dir + L"\\*.txt").c_str(), &find);
+	if (h_find == INVALID_HANDLE_VALUE)
+	{
+		return i_stamp;
+	}
+	do
+	{
+		if (find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		uint64_t i_hash = LibraryKey('F', find.cFileName, wcslen(find.cFileName));
+		i_hash = HashBytes(i_hash, &find.nFileSizeHigh, sizeof(find.nFileSizeHigh));
+		i_hash = HashBytes(i_hash, &find.nFileSizeLow, sizeof(find.nFileSizeLow));
+		i_hash = HashBytes(i_hash, &find.ftLastWriteTime.dwHighDateTime, sizeof(find.ftLastWriteTime.dwHighDateTime));
+		i_hash = HashBytes(i_hash, &find.ftLastWriteTime.dwLowDateTime, sizeof(find.ftLastWriteTime.dwLowDateTime));
+		i_stamp += i_hash;
+	} while (FindNextFileW(h_find, &find));
+	FindClose(h_find);
+	return i_stamp;
+}
+
+static void AddKeyLines(const char *p, const char *p_end, library_slot_t slot, std::vector<library_slot_t> &keys)
+{
+	static const struct { const char *psz_token; char type; } tokens[] =
+	{
+		{ "discid;", 'D' },
+		{ "serial;", 'S' },
+		{ "volume;", 'V' },
+	};
+	const char *p_eol, *p_line_end;
+	std::wstring text;
+
+	for (; p < p_end; p = p_eol + 1)
+	{
+		p_eol = (const char *)memchr(p, '\n', p_end - p);
+		if (p_eol == NULL)
+			p_eol = p_end;
+		p_line_end = p_eol;
+		while ((p_line_end > p) && ((p_line_end[-1] == '\r') || (p_line_end[-1] == ' ') || (p_line_end[-1] == '\t')))
+			p_line_end--;
+
+		for (auto &token : tokens)
+		{
+			size_t i_len = strlen(token.psz_token);
+			if (((size_t)(p_line_end - p) > i_len) && (memcmp(p, token.psz_token, i_len) == 0))
+			{
+				text.assign(p + i_len, p_line_end);
+				slot.i_key = LibraryKey(token.type, text.c_str(), text.size());
+				keys.push_back(slot);
+				break;
+			}
+		}
+	}
+}
+
+static int LibraryBuild(vlc_object_t *p_obj, const std::wstring &dir, const std::wstring &library, uint64_t i_source_stamp)
+{
+	std::vector<char> data;
+	std::vector<library_slot_t> keys;
+	std::vector<library_slot_t> table;
+	library_header_t header;
+	WIN32_FIND_DATAW find;
+	HANDLE h_find;
+	HANDLE h_file;
+	filter_file_map_t map;
+	uint32_t i_buckets = 16;
+	uint32_t i_data_start;
+	unsigned int i_files = 0;
+	unsigned int i_duplicates = 0;
+	DWORD i_written;
+	bool b_ok;
+	mtime_t start_time = mdate();
+
+	h_find = FindFirstFileW((dir + L"\\*.txt").c_str(), &find);
+	if (h_find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+			if (FilterFileMap((dir + L"\\" + find.cFileName).c_str(), &map) != VLC_SUCCESS)
+			{
+				msg_Warn(p_obj, "Couldn't read filter file %S for library\n", find.cFileName);
+				continue;
+			}
+			library_slot_t slot = { 0, (uint32_t)data.size(), (uint32_t)map.i_size };
+			data.insert(data.end(), map.p_data, map.p_data + map.i_size);
+
+			// file name is the volume name
+			std::wstring name = find.cFileName;
+			name.erase(name.size() - 4);
+			slot.i_key = LibraryKey('V', name.c_str(), name.size());
+			keys.push_back(slot);
+			AddKeyLines(map.p_data, map.p_data + map.i_size, slot, keys);
+
+			FilterFileUnmap(&map);
+			i_files++;
+		} while (FindNextFileW(h_find, &find));
+		FindClose(h_find);
+	}
+
+	// open addressing, at most half full
+	while (i_buckets < keys.size() * 2)
+	{
+		i_buckets <<= 1;
+	}
+	i_data_start = sizeof(header) + i_buckets * sizeof(library_slot_t);
+	table.resize(i_buckets);
+	memset(table.data(), 0, i_buckets * sizeof(library_slot_t));
+	for (library_slot_t &key : keys)
+	{
+		uint32_t i = key.i_key & (i_buckets - 1);
+		while ((table[i].i_key != 0) && (table[i].i_key != key.i_key))
+		{
+			i = (i + 1) & (i_buckets - 1);
+		}
+		if (table[i].i_key != 0)
+		{
+			// same key twice in one file is fine, across files the first one wins
+			if (table[i].i_offset != key.i_offset + i_data_start)
+				i_duplicates++;
+			continue;
+		}
+		table[i] = key;
+		table[i].i_offset += i_data_start;
+	}
+
+	memcpy(header.magic, LIBRARY_MAGIC, 4);
+	header.i_version = LIBRARY_VERSION;
+	header.i_buckets = i_buckets;
+	header.i_files = i_files;
+	header.i_source_stamp = i_source_stamp;
+
+	// write to temp file & then replace, so a half written library is never used
+	std::wstring temp = library + L".tmp";
+	h_file = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h_file == INVALID_HANDLE_VALUE)
+	{
+		msg_Warn(p_obj, "Couldn't create filter library %S\n", temp.c_str());
+		return VLC_EGENERIC;
+	}
+	b_ok = WriteFile(h_file, &header, sizeof(header), &i_written, NULL) &&
+		WriteFile(h_file, table.data(), i_buckets * sizeof(library_slot_t), &i_written, NULL) &&
+		(data.empty() || WriteFile(h_file, data.data(), (DWORD)data.size(), &i_written, NULL));
+	CloseHandle(h_file);
+	if (!b_ok || !MoveFileExW(temp.c_str(), library.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		msg_Warn(p_obj, "Couldn't write filter library %S\n", library.c_str());
+		DeleteFileW(temp.c_str());
+		return VLC_EGENERIC;
+	}
+
+	msg_Info(p_obj, "Filter library rebuilt: %u files, %u keys (%u duplicates ignored), %lld us\n",
+		i_files, (unsigned int)keys.size(), i_duplicates, mdate() - start_time);
+	return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+* library lookup
+*****************************************************************************/
+// b_stamp: check the library was built from the filter files as they are now
+static int LibraryOpen(const std::wstring &library, bool b_stamp, uint64_t i_source_stamp, filter_file_map_t *p_map)
+{
+	const library_header_t *p_header;
+
+	if (FilterFileMap(library.c_str(), p_map) != VLC_SUCCESS)
+	{
+		return VLC_EGENERIC;
+	}
+	p_header = (const library_header_t *)p_map->p_data;
+	if ((p_map->i_size < sizeof(*p_header)) ||
+		(memcmp(p_header->magic, LIBRARY_MAGIC, 4) != 0) ||
+		(p_header->i_version != LIBRARY_VERSION) ||
+		(b_stamp && (p_header->i_source_stamp != i_source_stamp)) ||
+		(p_header->i_buckets == 0) || (p_header->i_buckets & (p_header->i_buckets - 1)) ||
+		(p_map->i_size < sizeof(*p_header) + (size_t)p_header->i_buckets * sizeof(library_slot_t)))
+	{
+		FilterFileUnmap(p_map);
+		return VLC_EGENERIC;
+	}
+	return VLC_SUCCESS;
+}
+
+static const library_slot_t *LibraryFind(const filter_file_map_t *p_map, uint64_t i_key)
+{
+	const library_header_t *p_header = (const library_header_t *)p_map->p_data;
+	const library_slot_t *p_slots = (const library_slot_t *)(p_map->p_data + sizeof(*p_header));
+	const uint32_t i_mask = p_header->i_buckets - 1;
+	uint32_t i = i_key & i_mask;
+
+	for (uint32_t n = 0; n < p_header->i_buckets; n++, i = (i + 1) & i_mask)
+	{
+		if (p_slots[i].i_key == 0)
+			break;
+		if (p_slots[i].i_key == i_key)
+		{
+			if ((size_t)p_slots[i].i_offset + p_slots[i].i_size > p_map->i_size)
+				break;
+			return &p_slots[i];
+		}
+	}
+	return NULL;
+}
+
+int FilterLibraryLoad(vlc_object_t *p_obj, const wchar_t *psz_dir, uint64_t i_disc_id, uint32_t i_serial, const wchar_t *psz_volume, std::vector<FilterFileEntry> &entries, bool *pb_dvd_timescale)
+{
+	std::wstring library = std::wstring(psz_dir) + L".bin";
+	WIN32_FILE_ATTRIBUTE_DATA dir_info;
+	uint64_t i_source_stamp;
+	filter_file_map_t map;
+	wchar_t psz_text[17];
+	struct { uint64_t i_key; const char *psz_by; } keys[3];
+	int i_keys = 0;
+
+	if (!GetFileAttributesExW(psz_dir, GetFileExInfoStandard, &dir_info))
+	{
+		return VLC_EGENERIC;
+	}
+	if (!(dir_info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+	{
+		return VLC_EGENERIC;
+	}
+	i_source_stamp = LibrarySourceStamp(psz_dir);
+	if (LibraryOpen(library, true, i_source_stamp, &map) != VLC_SUCCESS)
+	{
+		if ((LibraryBuild(p_obj, psz_dir, library, i_source_stamp) != VLC_SUCCESS) ||
+			(LibraryOpen(library, true, i_source_stamp, &map) != VLC_SUCCESS))
+		{
+			return VLC_EGENERIC;
+		}
+	}
+
+	// most specific first
+	if (i_disc_id != 0)
+	{
+		swprintf_s(psz_text, ARRAYSIZE(psz_text), L"%016llX", i_disc_id);
+		keys[i_keys++] = { LibraryKey('D', psz_text, 16), "disc id" };
+	}
+	if (i_serial != 0)
+	{
+		swprintf_s(psz_text, ARRAYSIZE(psz_text), L"%08X", i_serial);
+		keys[i_keys++] = { LibraryKey('S', psz_text, 8), "serial number" };
+	}
+	if ((psz_volume != NULL) && (psz_volume[0] != 0))
+	{
+		keys[i_keys++] = { LibraryKey('V', psz_volume, wcslen(psz_volume)), "volume name" };
+	}
+
+	for (int i = 0; i < i_keys; i++)
+	{
+		const library_slot_t *p_slot = LibraryFind(&map, keys[i].i_key);
+		if (p_slot != NULL)
+		{
+			msg_Info(p_obj, "Filter file found in library by %s\n", keys[i].psz_by);
+			FilterFileParseBuffer(p_obj, library.c_str(), map.p_data + p_slot->i_offset, p_slot->i_size, entries, pb_dvd_timescale);
+			FilterFileUnmap(&map);
+			return VLC_SUCCESS;
+		}
+	}
+	FilterFileUnmap(&map);
+	return VLC_EGENERIC;
+}
+
+bool FilterLibraryHas(const wchar_t *psz_dir, const wchar_t *psz_volume)
+{
+	filter_file_map_t map;
+	bool b_found;
+
+	if ((psz_volume == NULL) || (psz_volume[0] == 0) || (LibraryOpen(std::wstring(psz_dir) + L".bin", false, 0, &map) != VLC_SUCCESS))
+	{
+		return false;
+	}
+	b_found = (LibraryFind(&map, LibraryKey('V', psz_volume, wcslen(psz_volume))) != NULL);
+	FilterFileUnmap(&map);
+	return b_found;
+}
@@ -0,0 +1,312 @@
+/*****************************************************************************
+ * IfoIndex.c : dvd title time -> sector index, from the IFO files
+ *****************************************************************************
+ * Seeking dvdnav by position (time / length) only lands roughly where it
+ * should, so a skip could take a few jumps.  The IFOs already have what's
+ * needed to do better:
+ *   - the time map (VTS_TMAPTI) gives the VOBU sector every few seconds
+ *   - the VOBU address map (VTS_VOBU_ADMAP) gives the sector of every VOBU
+ *   - the cell playback table of the title's pgc gives the sector range
+ * Time is interpolated between time map entries, then snapped forward to
+ * the start of a VOBU, which is a clean entry point for the decoders.
+ *
+ * Multi angle titles (interleaved cells) aren't indexed, these still use the
+ * old proportional seek.
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "spudec.h"
+#include "FilterFile.h"
+#include "IfoIndex.h"
+
+#define DVD_SECTOR_SIZE 2048
+
+static int ReadIfo(const wchar_t *psz_root, const wchar_t *psz_name, std::vector<uint8_t> &ifo)
+{
+	std::wstring filename = std::wstring(psz_root) + L"VIDEO_TS\\" + psz_name;
+	filter_file_map_t map;
+
+	if (FilterFileMap(filename.c_str(), &map) != VLC_SUCCESS)
+	{
+		return VLC_EGENERIC;
+	}
+	ifo.assign(map.p_data, map.p_data + map.i_size);
+	FilterFileUnmap(&map);
+	return VLC_SUCCESS;
+}
+
+static inline bool IfoHas(const std::vector<uint8_t> &ifo, size_t i_offset, size_t i_size)
+{
+	return (i_offset <= ifo.size()) && (i_size <= ifo.size() - i_offset);
+}
+
+// bcd hh:mm:ss:ff, top 2 bits of ff are the frame rate
+static mtime_t BcdTime(const uint8_t *p)
+{
+#define BCD(x) (((((x) >> 4) & 0xf) * 10) + ((x) & 0xf))
+	mtime_t time = (((mtime_t)BCD(p[0]) * 60 + BCD(p[1])) * 60 + BCD(p[2])) * CLOCK_FREQ;
+	int i_fps = ((p[3] >> 6) == 3) ? 30 : 25;
+
+	return time + (BCD(p[3] & 0x3f) * CLOCK_FREQ / i_fps);
+#undef BCD
+}
+
+// title set number & title number within the set, from VIDEO_TS.IFO
+static bool TitleToVts(const std::vector<uint8_t> &vmg, int i_title, int *pi_vts, int *pi_ttn)
+{
+	size_t i_srpt;
+
+	if (!IfoHas(vmg, 0, 0xC8) || (memcmp(vmg.data(), "DVDVIDEO-VMG", 12) != 0))
+		return false;
+	i_srpt = (size_t)GetDWBE(&vmg[0xC4]) * DVD_SECTOR_SIZE;
+	if (!IfoHas(vmg, i_srpt, 8) || (i_title < 1) || (i_title > GetWBE(&vmg[i_srpt])))
+		return false;
+	i_srpt += 8 + (i_title - 1) * 12;
+	if (!IfoHas(vmg, i_srpt, 12))
+		return false;
+	*pi_vts = vmg[i_srpt + 6];
+	*pi_ttn = vmg[i_srpt + 7];
+	return true;
+}
+
+// first pgc of title i_ttn in the title set, returns offset of pgc in vts or 0
+static size_t TitlePgc(const std::vector<uint8_t> &vts, int i_ttn, int *pi_pgcn)
+{
+	size_t i_ptt, i_pgcit, i_srp;
+
+	if (!IfoHas(vts, 0, 0xE8) || (memcmp(vts.data(), "DVDVIDEO-VTS", 12) != 0))
+		return 0;
+
+	// part of title table: first part of the title gives the pgc
+	i_ptt = (size_t)GetDWBE(&vts[0xC8]) * DVD_SECTOR_SIZE;
+	if (!IfoHas(vts, i_ptt, 8) || (i_ttn < 1) || (i_ttn > GetWBE(&vts[i_ptt])) || !IfoHas(vts, i_ptt + 8 + (i_ttn - 1) * 4, 4))
+		return 0;
+	i_ptt += GetDWBE(&vts[i_ptt + 8 + (i_ttn - 1) * 4]);
+	if (!IfoHas(vts, i_ptt, 4))
+		return 0;
+	*pi_pgcn = GetWBE(&vts[i_ptt]);
+
+	i_pgcit = (size_t)GetDWBE(&vts[0xCC]) * DVD_SECTOR_SIZE;
+	if (!IfoHas(vts, i_pgcit, 8) || (*pi_pgcn < 1) || (*pi_pgcn > GetWBE(&vts[i_pgcit])))
+		return 0;
+	i_srp = i_pgcit + 8 + (*pi_pgcn - 1) * 8;
+	if (!IfoHas(vts, i_srp, 8) || !IfoHas(vts, i_pgcit + GetDWBE(&vts[i_srp + 4]), 0xEC))
+		return 0;
+	return i_pgcit + GetDWBE(&vts[i_srp + 4]);
+}
+
+// title offset of a sector, false if it isn't in one of the title's cells
+static bool SectorToOffset(const ifo_title_index_t *p_index, uint32_t i_sector, uint32_t *pi_offset)
+{
+	uint32_t i_offset = 0;
+
+	for (size_t i = 0; i < p_index->cell_first.size(); i++)
+	{
+		if ((i_sector >= p_index->cell_first[i]) && (i_sector <= p_index->cell_last[i]))
+		{
+			*pi_offset = i_offset + i_sector - p_index->cell_first[i];
+			return true;
+		}
+		i_offset += p_index->cell_last[i] - p_index->cell_first[i] + 1;
+	}
+	return false;
+}
+
+static uint32_t OffsetToSector(const ifo_title_index_t *p_index, uint32_t i_offset)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < p_index->cell_first.size(); i++)
+	{
+		if (i_offset <= p_index->cell_last[i] - p_index->cell_first[i])
+			break;
+		i_offset -= p_index->cell_last[i] - p_index->cell_first[i] + 1;
+	}
+	return p_index->cell_first[i] + i_offset;
+}
+
+static int BuildIndex(vlc_object_t *p_obj, const std::vector<uint8_t> &vts, size_t i_pgc, int i_pgcn, ifo_title_index_t *p_index)
+{
+	size_t i_cells = i_pgc + GetWBE(&vts[i_pgc + 0xE8]);
+	int i_nr_cells = vts[i_pgc + 3];
+	size_t i_tmapti, i_admap;
+	uint32_t i_sector, i_offset;
+
+	p_index->cell_first.clear();
+	p_index->cell_last.clear();
+	p_index->anchor_time.clear();
+	p_index->anchor_offset.clear();
+	p_index->vobu.clear();
+
+	if ((i_nr_cells == 0) || !IfoHas(vts, i_cells, i_nr_cells * 24))
+		return VLC_EGENERIC;
+	for (int i = 0; i < i_nr_cells; i++)
+	{
+		// block type 1 is an angle block, cells are interleaved
+		if (((vts[i_cells + i * 24] >> 4) & 0x3) == 1)
+		{
+			msg_Dbg(p_obj, "ifo index: title has multiple angles, not indexed\n");
+			return VLC_EGENERIC;
+		}
+		// cells needn't follow on from each other (seamless branching), the sectors between belong to other pgcs
+		p_index->cell_first.push_back(GetDWBE(&vts[i_cells + i * 24 + 8]));
+		p_index->cell_last.push_back(GetDWBE(&vts[i_cells + i * 24 + 20]));
+		if (p_index->cell_last.back() < p_index->cell_first.back())
+			return VLC_EGENERIC;
+	}
+	i_offset = 0;
+	for (int i = 0; i < i_nr_cells; i++)
+		i_offset += p_index->cell_last[i] - p_index->cell_first[i] + 1;
+	p_index->i_sectors = i_offset;
+	p_index->i_length = BcdTime(&vts[i_pgc + 4]);
+	if ((p_index->i_sectors < 2) || (p_index->i_length <= 0))
+		return VLC_EGENERIC;
+
+	// time map: entry n is the VOBU playing at (n+1) * time unit
+	p_index->anchor_time.push_back(0);
+	p_index->anchor_offset.push_back(0);
+	i_tmapti = (size_t)GetDWBE(&vts[0xD4]) * DVD_SECTOR_SIZE;
+	if ((i_tmapti != 0) && IfoHas(vts, i_tmapti, 8) && (i_pgcn <= GetWBE(&vts[i_tmapti])) && IfoHas(vts, i_tmapti + 8 + (i_pgcn - 1) * 4, 4))
+	{
+		size_t i_tmap = i_tmapti + GetDWBE(&vts[i_tmapti + 8 + (i_pgcn - 1) * 4]);
+		if (IfoHas(vts, i_tmap, 4) && (vts[i_tmap] != 0))
+		{
+			mtime_t i_unit = vts[i_tmap] * CLOCK_FREQ;
+			int i_entries = GetWBE(&vts[i_tmap + 2]);
+			for (int i = 0; (i < i_entries) && IfoHas(vts, i_tmap + 4 + i * 4, 4); i++)
+			{
+				// top bit is discontinuity flag
+				i_sector = GetDWBE(&vts[i_tmap + 4 + i * 4]) & 0x7fffffff;
+				if (((i + 1) * i_unit < p_index->i_length) && SectorToOffset(p_index, i_sector, &i_offset) &&
+					(i_offset > p_index->anchor_offset.back()) && (i_offset < p_index->i_sectors - 1))
+				{
+					p_index->anchor_time.push_back((i + 1) * i_unit);
+					p_index->anchor_offset.push_back(i_offset);
+				}
+			}
+		}
+	}
+	p_index->anchor_time.push_back(p_index->i_length);
+	p_index->anchor_offset.push_back(p_index->i_sectors - 1);
+
+	// VOBU address map is for the whole title set, keep just the ones in this title's cells
+	i_admap = (size_t)GetDWBE(&vts[0xE4]) * DVD_SECTOR_SIZE;
+	if ((i_admap != 0) && IfoHas(vts, i_admap, 4))
+	{
+		size_t i_end = i_admap + GetDWBE(&vts[i_admap]) + 1;
+		for (size_t i = i_admap + 4; (i + 4 <= i_end) && IfoHas(vts, i, 4); i += 4)
+		{
+			if (SectorToOffset(p_index, GetDWBE(&vts[i]), &i_offset))
+			{
+				p_index->vobu.push_back(i_offset);
+			}
+		}
+		if (!std::is_sorted(p_index->vobu.begin(), p_index->vobu.end()))
+		{
+			std::sort(p_index->vobu.begin(), p_index->vobu.end());
+		}
+	}
+	if (p_index->vobu.empty())
+		return VLC_EGENERIC;
+
+	return VLC_SUCCESS;
+}
+
+static int LoadTitle(vlc_object_t *p_obj, const wchar_t *psz_root, const std::vector<uint8_t> &vmg, int i_title,
+	std::vector<std::vector<uint8_t>> &vts_cache, ifo_title_index_t *p_index, bool b_length_only)
+{
+	int i_vts, i_ttn, i_pgcn;
+	size_t i_pgc;
+	wchar_t psz_name[16];
+
+	if (!TitleToVts(vmg, i_title, &i_vts, &i_ttn) || (i_vts < 1) || (i_vts > 99))
+		return VLC_EGENERIC;
+	if (vts_cache.size() <= (size_t)i_vts)
+		vts_cache.resize(i_vts + 1);
+	if (vts_cache[i_vts].empty())
+	{
+		swprintf_s(psz_name, ARRAYSIZE(psz_name), L"VTS_%02d_0.IFO", i_vts);
+		if (ReadIfo(psz_root, psz_name, vts_cache[i_vts]) != VLC_SUCCESS)
+			return VLC_EGENERIC;
+	}
+	i_pgc = TitlePgc(vts_cache[i_vts], i_ttn, &i_pgcn);
+	if (i_pgc == 0)
+		return VLC_EGENERIC;
+
+	p_index->i_title = i_title;
+	if (b_length_only)
+	{
+		p_index->i_length = BcdTime(&vts_cache[i_vts][i_pgc + 4]);
+		return VLC_SUCCESS;
+	}
+	return BuildIndex(p_obj, vts_cache[i_vts], i_pgc, i_pgcn, p_index);
+}
+
+int IfoTitleIndexLoad(vlc_object_t *p_obj, const wchar_t *psz_root, int i_title, ifo_title_index_t *p_index)
+{
+	std::vector<uint8_t> vmg;
+	std::vector<std::vector<uint8_t>> vts_cache;
+	ifo_title_index_t title;
+	mtime_t i_longest = 0;
+	mtime_t start_time = mdate();
+
+	p_index->i_title = 0;
+	if (ReadIfo(psz_root, L"VIDEO_TS.IFO", vmg) != VLC_SUCCESS)
+		return VLC_EGENERIC;
+
+	// main movie is the longest title
+	if ((i_title == 0) && IfoHas(vmg, 0xC8, 0))
+	{
+		size_t i_srpt = (size_t)GetDWBE(&vmg[0xC4]) * DVD_SECTOR_SIZE;
+		int i_titles = IfoHas(vmg, i_srpt, 2) ? GetWBE(&vmg[i_srpt]) : 0;
+		for (int i = 1; i <= i_titles; i++)
+		{
+			if ((LoadTitle(p_obj, psz_root, vmg, i, vts_cache, &title, true) == VLC_SUCCESS) && (title.i_length > i_longest))
+			{
+				i_longest = title.i_length;
+				i_title = i;
+			}
+		}
+	}
+
+	if (LoadTitle(p_obj, psz_root, vmg, i_title, vts_cache, p_index, false) != VLC_SUCCESS)
+	{
+		p_index->i_title = 0;
+		msg_Dbg(p_obj, "ifo index: couldn't index title %d\n", i_title);
+		return VLC_EGENERIC;
+	}
+	msg_Info(p_obj, "ifo index: title %d, length %lld us, %u sectors in %u cells, %u time map points, %u VOBUs, %lld us\n",
+		p_index->i_title, p_index->i_length, p_index->i_sectors, (unsigned int)p_index->cell_first.size(),
+		(unsigned int)p_index->anchor_time.size() - 2, (unsigned int)p_index->vobu.size(), mdate() - start_time);
+	return VLC_SUCCESS;
+}
+
+bool IfoTimeToPosition(const ifo_title_index_t *p_index, mtime_t time, double *pf_position, uint32_t *pi_sector)
+{
+	size_t b;
+	uint32_t i_offset;
+
+	if (p_index->i_title == 0)
+		return false;
+
+	// interpolate between the time map points either side
+	time = VLC_CLIP(time, 0, p_index->i_length);
+	b = std::upper_bound(p_index->anchor_time.begin(), p_index->anchor_time.end(), time) - p_index->anchor_time.begin();
+	b = VLC_CLIP(b, 1, p_index->anchor_time.size() - 1);
+	i_offset = p_index->anchor_offset[b - 1] + (uint32_t)((time - p_index->anchor_time[b - 1]) *
+		(int64_t)(p_index->anchor_offset[b] - p_index->anchor_offset[b - 1]) / (p_index->anchor_time[b] - p_index->anchor_time[b - 1]));
+
+	// then snap forward to a VOBU start
+	auto vobu = std::lower_bound(p_index->vobu.begin(), p_index->vobu.end(), i_offset);
+	if (vobu == p_index->vobu.end())
+		--vobu;
+	*pi_sector = OffsetToSector(p_index, *vobu);
+
+	// dvdnav truncates position * length back to a sector, so aim for the middle of the sector
+	*pf_position = ((double)*vobu + 0.5) / (double)p_index->i_sectors;
+	return true;
+}
@@ -0,0 +1,29 @@
+/*****************************************************************************
+ * IfoIndex.h : dvd title time -> sector index, from the IFO files
+ *****************************************************************************/
+
+#ifndef IFOINDEX_H
+#define IFOINDEX_H
+
+// one dvd title (its first pgc), sectors are relative to the title set VOBs like in the IFO
+typedef struct
+{
+	int i_title;                         // dvd title number (1 based), 0 if nothing loaded
+	std::vector<uint32_t> cell_first;    // first & last sector of each cell, in play order
+	std::vector<uint32_t> cell_last;
+	uint32_t i_sectors;                  // cell lengths added up, the title length for dvdnav
+	mtime_t i_length;
+	// offsets below count sectors through the cells end to end like dvdnav, so gaps between cells are skipped
+	std::vector<mtime_t> anchor_time;    // from the time map, plus start & end of title; increasing
+	std::vector<uint32_t> anchor_offset;
+	std::vector<uint32_t> vobu;          // offset of each VOBU start in the title, from the VOBU address map
+} ifo_title_index_t;
+
+// load index for i_title, or the longest title (main movie) if i_title is 0
+// psz_root is the disc root, eg. L"D:\\"
+int IfoTitleIndexLoad(vlc_object_t *p_obj, const wchar_t *psz_root, int i_title, ifo_title_index_t *p_index);
+
+// dvdnav position (0..1, with pgc positioning) of the first VOBU at or after time, false if no index
+bool IfoTimeToPosition(const ifo_title_index_t *p_index, mtime_t time, double *pf_position, uint32_t *pi_sector);
+
+#endif
@@ -0,0 +1,298 @@
+/*****************************************************************************
+ * MuteKernel.c : muting a range of samples, with short gain ramps at the ends
+ *****************************************************************************
+ * Cutting audio straight to silence clicks, so the gain ramps down over the
+ * first few ms of a mute and back up over the last few, and is 0 between.
+ * The gain only depends on the sample's position in the mute, so a mute
+ * (or a ramp) spread over several blocks comes out the same as in one.
+ *
+ * Silence isn't zero bytes for every format (u8 is 0x80), so each sample
+ * type has its own fill, and its own scaling, with SSE2 versions on x86 &
+ * x64.  Kernels are templates on the sample type and layout (interleaved,
+ * or planar: one plane per channel), picked once per format.
+ *
+ * Ramp gains are worked out a chunk at a time into a small buffer, one per
+ * sample (repeated for each channel of an interleaved frame), so scaling is
+ * one straight loop over samples & gains, whatever the channel count.
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_es.h>
+
+#include <cmath>
+
+#include "MuteKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+# define MUTE_KERNEL_SSE2
+# include <emmintrin.h>
+#endif
+
+// gains are worked out for this many samples at a time
+#define MUTE_GAIN_CHUNK 256
+// more channels than this (vlc has at most 9) and the ramps are left out
+#define MUTE_CHANNELS_MAX 32
+
+/*****************************************************************************
+ * per sample type: filling with silence & scaling by a gain
+ *****************************************************************************/
+static inline uint8_t ScaleSample(uint8_t x, float g) { return (uint8_t)(128 + lrintf((x - 128) * g)); }
+static inline int16_t ScaleSample(int16_t x, float g) { return (int16_t)lrintf(x * g); }
+static inline int32_t ScaleSample(int32_t x, float g) { return (int32_t)lrint((double)x * g); }
+static inline float ScaleSample(float x, float g) { return x * g; }
+static inline double ScaleSample(double x, float g) { return x * g; }
+
+template <typename T>
+struct SampleOps
+{
+	static void Fill(T *p_samples, size_t i_count)
+	{
+		memset(p_samples, 0, i_count * sizeof(T));
+	}
+	static void Scale(T *p_samples, const float *p_gains, size_t i_count)
+	{
+		for (size_t i = 0; i < i_count; i++)
+			p_samples[i] = ScaleSample(p_samples[i], p_gains[i]);
+	}
+};
+
+template <>
+void SampleOps<uint8_t>::Fill(uint8_t *p_samples, size_t i_count)
+{
+	memset(p_samples, 0x80, i_count);
+}
+
+#ifdef MUTE_KERNEL_SSE2
+template <>
+void SampleOps<int16_t>::Scale(int16_t *p_samples, const float *p_gains, size_t i_count)
+{
+	size_t i = 0;
+	for (; i + 8 <= i_count; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(p_samples + i));
+		// sign extend to 32 bits
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		__m128 flo = _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_loadu_ps(p_gains + i));
+		__m128 fhi = _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_loadu_ps(p_gains + i + 4));
+		_mm_storeu_si128((__m128i *)(p_samples + i), _mm_packs_epi32(_mm_cvtps_epi32(flo), _mm_cvtps_epi32(fhi)));
+	}
+	for (; i < i_count; i++)
+		p_samples[i] = ScaleSample(p_samples[i], p_gains[i]);
+}
+
+template <>
+void SampleOps<int32_t>::Scale(int32_t *p_samples, const float *p_gains, size_t i_count)
+{
+	size_t i = 0;
+	// in double, a float only has 24 bits
+	for (; i + 4 <= i_count; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(p_samples + i));
+		__m128 g = _mm_loadu_ps(p_gains + i);
+		__m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(x), _mm_cvtps_pd(g));
+		__m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), _mm_cvtps_pd(_mm_movehl_ps(g, g)));
+		_mm_storeu_si128((__m128i *)(p_samples + i), _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo), _mm_cvtpd_epi32(hi)));
+	}
+	for (; i < i_count; i++)
+		p_samples[i] = ScaleSample(p_samples[i], p_gains[i]);
+}
+
+template <>
+void SampleOps<float>::Scale(float *p_samples, const float *p_gains, size_t i_count)
+{
+	size_t i = 0;
+	for (; i + 4 <= i_count; i += 4)
+		_mm_storeu_ps(p_samples + i, _mm_mul_ps(_mm_loadu_ps(p_samples + i), _mm_loadu_ps(p_gains + i)));
+	for (; i < i_count; i++)
+		p_samples[i] = ScaleSample(p_samples[i], p_gains[i]);
+}
+
+template <>
+void SampleOps<double>::Scale(double *p_samples, const float *p_gains, size_t i_count)
+{
+	size_t i = 0;
+	for (; i + 4 <= i_count; i += 4)
+	{
+		__m128 g = _mm_loadu_ps(p_gains + i);
+		_mm_storeu_pd(p_samples + i, _mm_mul_pd(_mm_loadu_pd(p_samples + i), _mm_cvtps_pd(g)));
+		_mm_storeu_pd(p_samples + i + 2, _mm_mul_pd(_mm_loadu_pd(p_samples + i + 2), _mm_cvtps_pd(_mm_movehl_ps(g, g))));
+	}
+	for (; i < i_count; i++)
+		p_samples[i] = ScaleSample(p_samples[i], p_gains[i]);
+}
+#endif
+
+/*****************************************************************************
+ * kernels
+ *****************************************************************************/
+// i_frames linear gains from g0, each repeated i_repeat times
+static void FillGains(float *p_gains, size_t i_frames, unsigned int i_repeat, float g0, float step)
+{
+	for (size_t i = 0; i < i_frames; i++)
+	{
+		float g = g0 + i * step;
+		g = (g < 0.0f) ? 0.0f : ((g > 1.0f) ? 1.0f : g);
+		for (unsigned int c = 0; c < i_repeat; c++)
+			*p_gains++ = g;
+	}
+}
+
+// samples [i_from, i_to) of every channel, with gain going from g0 by step each sample
+template <typename T, bool b_planar>
+static void MuteRamp(T *p_samples, unsigned int i_nb_samples, unsigned int i_channels, int64_t i_from, int64_t i_to, float g0, float step)
+{
+	float gains[MUTE_GAIN_CHUNK];
+
+	if (b_planar)
+	{
+		for (int64_t n = i_from; n < i_to; n += MUTE_GAIN_CHUNK)
+		{
+			size_t i_count = (size_t)__MIN(MUTE_GAIN_CHUNK, i_to - n);
+			FillGains(gains, i_count, 1, g0 + (n - i_from) * step, step);
+			for (unsigned int c = 0; c < i_channels; c++)
+				SampleOps<T>::Scale(p_samples + (size_t)c * i_nb_samples + n, gains, i_count);
+		}
+	}
+	else
+	{
+		const int64_t i_chunk = MUTE_GAIN_CHUNK / i_channels;
+		for (int64_t n = i_from; n < i_to; n += i_chunk)
+		{
+			size_t i_frames = (size_t)__MIN(i_chunk, i_to - n);
+			FillGains(gains, i_frames, i_channels, g0 + (n - i_from) * step, step);
+			SampleOps<T>::Scale(p_samples + n * i_channels, gains, i_frames * i_channels);
+		}
+	}
+}
+
+template <typename T, bool b_planar>
+static void MuteSilence(T *p_samples, unsigned int i_nb_samples, unsigned int i_channels, int64_t i_from, int64_t i_to)
+{
+	if (i_from >= i_to)
+		return;
+	if (b_planar)
+	{
+		for (unsigned int c = 0; c < i_channels; c++)
+			SampleOps<T>::Fill(p_samples + (size_t)c * i_nb_samples + i_from, (size_t)(i_to - i_from));
+	}
+	else
+	{
+		SampleOps<T>::Fill(p_samples + i_from * i_channels, (size_t)(i_to - i_from) * i_channels);
+	}
+}
+
+// gain at sample n is 1 - d / ramp, d being how far into the mute it is from the nearer end (1 for the end samples), & 0 past the ramps
+template <typename T, bool b_planar>
+static void MuteKernel(uint8_t *p_buffer, unsigned int i_nb_samples, unsigned int i_channels, const mute_ramp_t *p_ramp)
+{
+	T *p_samples = (T *)p_buffer;
+	const int64_t i_first = p_ramp->i_first;
+	const int64_t i_last = p_ramp->i_last;
+	const int64_t i_ramp = (i_channels <= MUTE_CHANNELS_MAX) ? p_ramp->i_ramp : 0;
+	const int64_t i_from = __MAX(i_first, 0);
+	const int64_t i_to = __MIN(i_last, (int64_t)i_nb_samples);
+
+	if ((i_from >= i_to) || (i_channels == 0))
+		return;
+
+	// block split into ramp down, silence, ramp up; any of them may be empty
+	const int64_t i_flat_from = __MIN(__MAX(i_first + i_ramp, i_from), i_to);
+	const int64_t i_flat_to = __MIN(__MAX(i_last - i_ramp, i_flat_from), i_to);
+	const float step = (i_ramp > 0) ? 1.0f / i_ramp : 0.0f;
+
+	MuteRamp<T, b_planar>(p_samples, i_nb_samples, i_channels, i_from, i_flat_from, 1.0f - (i_from - i_first + 1) * step, -step);
+	MuteSilence<T, b_planar>(p_samples, i_nb_samples, i_channels, i_flat_from, i_flat_to);
+	MuteRamp<T, b_planar>(p_samples, i_nb_samples, i_channels, i_flat_to, i_to, 1.0f - (i_last - i_flat_to) * step, step);
+}
+
+template <typename T>
+static mute_kernel_t MuteKernelFor(bool b_planar)
+{
+	return b_planar ? &MuteKernel<T, true> : &MuteKernel<T, false>;
+}
+
+mute_kernel_t MuteKernelGet(vlc_fourcc_t i_format, bool b_planar)
+{
+	switch (i_format)
+	{
+		case VLC_CODEC_U8:
+			return MuteKernelFor<uint8_t>(b_planar);
+		case VLC_CODEC_S16N:
+			return MuteKernelFor<int16_t>(b_planar);
+		case VLC_CODEC_S32N:
+			return MuteKernelFor<int32_t>(b_planar);
+		case VLC_CODEC_FL32:
+			return MuteKernelFor<float>(b_planar);
+		case VLC_CODEC_FL64:
+			return MuteKernelFor<double>(b_planar);
+		default:
+			return NULL;
+	}
+}
+
+/*****************************************************************************
+ * benchmark
+ *****************************************************************************/
+// ac3 sized blocks of 48 kHz stereo, each with a 5 ms ramp down, silence & 5 ms ramp up, which is about as much ramp as real use sees
+#define MUTE_BENCH_BLOCK    1536
+#define MUTE_BENCH_CHANNELS 2
+#define MUTE_BENCH_RAMP     240
+// blocks are refilled between passes (not timed), else the ramps scale the same samples down to denormals, which are slow
+#define MUTE_BENCH_BLOCKS   32
+#define MUTE_BENCH_PASSES   64
+
+void MuteKernelBenchmark(vlc_object_t *p_obj)
+{
+	static const struct
+	{
+		vlc_fourcc_t i_format;
+		const char *psz_name;
+	} formats[] =
+	{
+		{ VLC_CODEC_U8, "u8" },
+		{ VLC_CODEC_S16N, "s16" },
+		{ VLC_CODEC_S32N, "s32" },
+		{ VLC_CODEC_FL32, "float" },
+		{ VLC_CODEC_FL64, "double" },
+	};
+	const size_t i_samples = (size_t)MUTE_BENCH_BLOCK * MUTE_BENCH_CHANNELS;
+	const size_t i_block_size = i_samples * sizeof(double);
+	uint8_t *p_buffer = (uint8_t *)malloc(i_block_size * MUTE_BENCH_BLOCKS);
+	mute_ramp_t ramp;
+
+	if (p_buffer == NULL)
+		return;
+	ramp.i_first = 100;
+	ramp.i_last = MUTE_BENCH_BLOCK - 100;
+	ramp.i_ramp = MUTE_BENCH_RAMP;
+
+	for (size_t f = 0; f < ARRAYSIZE(formats); f++)
+	{
+		for (int i_planar = 0; i_planar < 2; i_planar++)
+		{
+			mute_kernel_t pf_kernel = MuteKernelGet(formats[f].i_format, i_planar != 0);
+			mtime_t i_elapsed = 0;
+
+			for (int p = 0; p < MUTE_BENCH_PASSES; p++)
+			{
+				// 0x3f.. is a mid level sample in every format
+				memset(p_buffer, 0x3f, i_block_size * MUTE_BENCH_BLOCKS);
+				mtime_t i_start = mdate();
+				for (int i = 0; i < MUTE_BENCH_BLOCKS; i++)
+					pf_kernel(p_buffer + i * i_block_size, MUTE_BENCH_BLOCK, MUTE_BENCH_CHANNELS, &ramp);
+				i_elapsed += mdate() - i_start;
+			}
+			i_elapsed = __MAX(i_elapsed, 1);
+
+			msg_Info(p_obj, "mute kernel %s %s: %lld samples/s\n", formats[f].psz_name, i_planar ? "planar" : "interleaved",
+				(long long)((int64_t)i_samples * MUTE_BENCH_BLOCKS * MUTE_BENCH_PASSES * CLOCK_FREQ / i_elapsed));
+		}
+	}
+	free(p_buffer);
+}
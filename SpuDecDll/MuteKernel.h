@@ -0,0 +1,24 @@
+/*****************************************************************************
+ * MuteKernel.h : muting a range of samples, with short gain ramps at the ends
+ *****************************************************************************/
+
+#ifndef MUTEKERNEL_H
+#define MUTEKERNEL_H
+
+// a mute in samples from the start of the block; may start before it and end after it
+typedef struct
+{
+	int64_t i_first;
+	int64_t i_last;          // not included
+	unsigned int i_ramp;     // samples to fade over at each end, inside the mute; no more than half of it
+} mute_ramp_t;
+
+typedef void (*mute_kernel_t)(uint8_t *p_buffer, unsigned int i_nb_samples, unsigned int i_channels, const mute_ramp_t *p_ramp);
+
+// NULL if it's not a format we know the silence of
+mute_kernel_t MuteKernelGet(vlc_fourcc_t i_format, bool b_planar);
+
+// run every kernel over a made up block & log samples per second
+void MuteKernelBenchmark(vlc_object_t *p_obj);
+
+#endif
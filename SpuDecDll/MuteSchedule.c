@@ -0,0 +1,318 @@
+/*****************************************************************************
+ * MuteSchedule.c : mute intervals shared by the demux, spu & audio decoders
+ *****************************************************************************
+ * Replaces the mute_* integer vars on the input, which cost the audio
+ * decoder four variable lookups (lock & search) per block, could be seen
+ * half updated, and only had room for one mute from each side, so a second
+ * mute arriving before the first had played overwrote it.
+ *
+ * Each source pushes to its own ring, of which it's the only writer and the
+ * audio decoder the only reader, so neither side ever waits.  Rings are
+ * bounded; a push to a full one is counted as lost rather than block the
+ * demux or a decoder.
+ *
+ * The audio decoder moves whatever has been pushed into its own queue,
+ * kept in time order with overlapping (or touching) intervals merged.
+ * Mutes mostly arrive in time order, so an insert is normally at (or
+ * merged into) the tail.  Audio pts only goes forward between flushes, so
+ * intervals the audio has got past are dropped off the head, and checking
+ * a block is just a look at the head.
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "spudec.h"
+#include "MuteSchedule.h"
+
+#include <vlc_variables.h>
+
+#include <atomic>
+#include <new>
+
+// address var on the input that the decoders look the schedule up by
+#define MUTE_SCHEDULE_VAR "mvfilt-mute-schedule"
+
+// per source, power of 2; a couple of subtitles per second at most, and the audio decoder empties them every block
+#define MUTE_RING_SIZE 32
+
+typedef struct
+{
+	std::atomic<unsigned int> i_write;    // only the source changes this
+	std::atomic<unsigned int> i_read;     // only the audio decoder changes this
+	mute_interval_t intervals[MUTE_RING_SIZE];
+} mute_ring_t;
+
+// subtitles one spu path has noted that the other hasn't yet; they're never far apart
+#define OCR_TIMING_SIZE 16
+
+typedef struct
+{
+	mtime_t i_start;    // VLC_TS_INVALID if free
+	mtime_t i_time;
+	mtime_t i_ocr;
+} ocr_timing_t;
+
+struct mute_schedule_t
+{
+	std::atomic<unsigned int> i_refs;
+	std::atomic<unsigned int> i_lost;
+	mute_ring_t rings[MUTE_SOURCE_MAX];
+
+	// early ocr timing, [0] spu decoder & [1] early ocr; a couple of subtitles a second, so just locked
+	vlc_mutex_t  ocr_lock;
+	ocr_timing_t ocr_pending[2][OCR_TIMING_SIZE];
+	unsigned int i_ocr_next[2];
+	unsigned int i_ocr_matched;
+	mtime_t      i_ocr_gain;
+};
+
+mute_schedule_t *MuteScheduleCreate(vlc_object_t *p_input)
+{
+	mute_schedule_t *p_sched = new (std::nothrow) mute_schedule_t;
+	if (p_sched == NULL)
+		return NULL;
+
+	p_sched->i_refs.store(1);
+	p_sched->i_lost.store(0);
+	for (int i = 0; i < MUTE_SOURCE_MAX; i++)
+	{
+		p_sched->rings[i].i_write.store(0);
+		p_sched->rings[i].i_read.store(0);
+	}
+	vlc_mutex_init(&p_sched->ocr_lock);
+	for (int i = 0; i < 2; i++)
+	{
+		for (int j = 0; j < OCR_TIMING_SIZE; j++)
+			p_sched->ocr_pending[i][j].i_start = VLC_TS_INVALID;
+		p_sched->i_ocr_next[i] = 0;
+	}
+	p_sched->i_ocr_matched = 0;
+	p_sched->i_ocr_gain = 0;
+	var_Create(p_input, MUTE_SCHEDULE_VAR, VLC_VAR_ADDRESS);
+	var_SetAddress(p_input, MUTE_SCHEDULE_VAR, p_sched);
+	return p_sched;
+}
+
+void MuteScheduleDestroy(vlc_object_t *p_input, mute_schedule_t *p_sched)
+{
+	var_Destroy(p_input, MUTE_SCHEDULE_VAR);
+	MuteScheduleRelease(p_sched);
+}
+
+// decoders are only created while the demux is open, so the schedule can't go away between the lookup & the hold
+mute_schedule_t *MuteScheduleGet(vlc_object_t *p_input)
+{
+	mute_schedule_t *p_sched = (mute_schedule_t *)var_GetAddress(p_input, MUTE_SCHEDULE_VAR);
+	if (p_sched != NULL)
+		p_sched->i_refs.fetch_add(1, std::memory_order_relaxed);
+	return p_sched;
+}
+
+void MuteScheduleRelease(mute_schedule_t *p_sched)
+{
+	if ((p_sched != NULL) && (p_sched->i_refs.fetch_sub(1, std::memory_order_acq_rel) == 1))
+	{
+		vlc_mutex_destroy(&p_sched->ocr_lock);
+		delete p_sched;
+	}
+}
+
+bool MuteSchedulePush(mute_schedule_t *p_sched, mute_source_t i_source, mtime_t i_start, mtime_t i_end)
+{
+	mute_ring_t *p_ring = &p_sched->rings[i_source];
+	unsigned int i_write = p_ring->i_write.load(std::memory_order_relaxed);
+
+	if (i_write - p_ring->i_read.load(std::memory_order_acquire) == MUTE_RING_SIZE)
+	{
+		p_sched->i_lost.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	p_ring->intervals[i_write & (MUTE_RING_SIZE - 1)].i_start = i_start;
+	p_ring->intervals[i_write & (MUTE_RING_SIZE - 1)].i_end = i_end;
+	p_ring->i_write.store(i_write + 1, std::memory_order_release);
+	return true;
+}
+
+unsigned int MuteScheduleLost(mute_schedule_t *p_sched)
+{
+	return p_sched->i_lost.load(std::memory_order_relaxed);
+}
+
+void MuteScheduleOcrNote(mute_schedule_t *p_sched, mute_source_t i_source, mtime_t i_start, mtime_t i_time, mtime_t i_ocr)
+{
+	int i_side = (i_source == MUTE_SOURCE_EARLY_OCR) ? 1 : 0;
+	ocr_timing_t *p_other = p_sched->ocr_pending[1 - i_side];
+	ocr_timing_t *p_new;
+
+	if (i_start <= VLC_TS_INVALID)
+		return;
+
+	vlc_mutex_lock(&p_sched->ocr_lock);
+	for (int i = 0; i < OCR_TIMING_SIZE; i++)
+	{
+		if (p_other[i].i_start == i_start)
+		{
+			// the spu decoder would have spent about as long on the ocr as early ocr did
+			if (i_side == 0)
+				p_sched->i_ocr_gain += i_time + p_other[i].i_ocr - p_other[i].i_time;
+			else
+				p_sched->i_ocr_gain += p_other[i].i_time + i_ocr - i_time;
+			p_sched->i_ocr_matched++;
+			p_other[i].i_start = VLC_TS_INVALID;
+			vlc_mutex_unlock(&p_sched->ocr_lock);
+			return;
+		}
+	}
+	// other side hasn't got to it yet; anything it never gets to (seek, track change) is just overwritten
+	p_new = &p_sched->ocr_pending[i_side][p_sched->i_ocr_next[i_side]++ % OCR_TIMING_SIZE];
+	p_new->i_start = i_start;
+	p_new->i_time = i_time;
+	p_new->i_ocr = i_ocr;
+	vlc_mutex_unlock(&p_sched->ocr_lock);
+}
+
+// subtitles seen by both paths, and the total of how much sooner early ocr was done with them
+unsigned int MuteScheduleOcrGain(mute_schedule_t *p_sched, mtime_t *pi_total)
+{
+	unsigned int i_matched;
+
+	vlc_mutex_lock(&p_sched->ocr_lock);
+	i_matched = p_sched->i_ocr_matched;
+	*pi_total = p_sched->i_ocr_gain;
+	vlc_mutex_unlock(&p_sched->ocr_lock);
+	return i_matched;
+}
+
+/*****************************************************************************
+* audio decoder's queue
+*****************************************************************************/
+static inline mute_interval_t *MuteQueueAt(mute_queue_t *p_queue, unsigned int i)
+{
+	return &p_queue->intervals[(p_queue->i_head + i) % MUTE_QUEUE_SIZE];
+}
+
+void MuteQueueInit(mute_queue_t *p_queue)
+{
+	p_queue->i_head = 0;
+	p_queue->i_count = 0;
+	p_queue->i_queued = 0;
+	p_queue->i_merged = 0;
+	p_queue->i_lost = 0;
+	p_queue->i_peak = 0;
+}
+
+// seek: pts starts over, so nothing queued applies
+void MuteQueueFlush(mute_queue_t *p_queue)
+{
+	p_queue->i_head = 0;
+	p_queue->i_count = 0;
+}
+
+static void MuteQueueInsert(mute_queue_t *p_queue, mtime_t i_start, mtime_t i_end)
+{
+	unsigned int i, j;
+
+	if (i_end <= i_start)
+		return;
+	p_queue->i_queued++;
+
+	// where it goes: usually after the last one
+	i = p_queue->i_count;
+	while ((i > 0) && (MuteQueueAt(p_queue, i - 1)->i_start > i_start))
+		i--;
+
+	if ((i > 0) && (MuteQueueAt(p_queue, i - 1)->i_end >= i_start))
+	{
+		// overlaps (or follows on from) the one before
+		i--;
+		if (MuteQueueAt(p_queue, i)->i_end < i_end)
+			MuteQueueAt(p_queue, i)->i_end = i_end;
+		p_queue->i_merged++;
+	}
+	else
+	{
+		if (p_queue->i_count == MUTE_QUEUE_SIZE)
+		{
+			p_queue->i_lost++;
+			return;
+		}
+		for (j = p_queue->i_count; j > i; j--)
+			*MuteQueueAt(p_queue, j) = *MuteQueueAt(p_queue, j - 1);
+		MuteQueueAt(p_queue, i)->i_start = i_start;
+		MuteQueueAt(p_queue, i)->i_end = i_end;
+		p_queue->i_count++;
+	}
+
+	// it may now reach into the ones after it
+	mute_interval_t *p_merged = MuteQueueAt(p_queue, i);
+	for (j = i + 1; (j < p_queue->i_count) && (MuteQueueAt(p_queue, j)->i_start <= p_merged->i_end); j++)
+	{
+		if (p_merged->i_end < MuteQueueAt(p_queue, j)->i_end)
+			p_merged->i_end = MuteQueueAt(p_queue, j)->i_end;
+		p_queue->i_merged++;
+	}
+	if (j > i + 1)
+	{
+		unsigned int i_gone = j - (i + 1);
+		for (; j < p_queue->i_count; j++)
+			*MuteQueueAt(p_queue, j - i_gone) = *MuteQueueAt(p_queue, j);
+		p_queue->i_count -= i_gone;
+	}
+	if (p_queue->i_count > p_queue->i_peak)
+		p_queue->i_peak = p_queue->i_count;
+}
+
+// take everything the sources have pushed since last time
+void MuteQueueCollect(mute_schedule_t *p_sched, mute_queue_t *p_queue)
+{
+	for (int s = 0; s < MUTE_SOURCE_MAX; s++)
+	{
+		mute_ring_t *p_ring = &p_sched->rings[s];
+		unsigned int i_read = p_ring->i_read.load(std::memory_order_relaxed);
+		unsigned int i_write = p_ring->i_write.load(std::memory_order_acquire);
+
+		if (i_read == i_write)
+			continue;
+		for (; i_read != i_write; i_read++)
+		{
+			const mute_interval_t *p_interval = &p_ring->intervals[i_read & (MUTE_RING_SIZE - 1)];
+			MuteQueueInsert(p_queue, p_interval->i_start, p_interval->i_end);
+		}
+		p_ring->i_read.store(i_read, std::memory_order_release);
+	}
+}
+
+// drop whatever the audio is past, so only the head needs looking at
+static void MuteQueueExpire(mute_queue_t *p_queue, mtime_t i_pts)
+{
+	while ((p_queue->i_count > 0) && (MuteQueueAt(p_queue, 0)->i_end <= i_pts))
+	{
+		p_queue->i_head = (p_queue->i_head + 1) % MUTE_QUEUE_SIZE;
+		p_queue->i_count--;
+	}
+}
+
+bool MuteQueueCovers(mute_queue_t *p_queue, mtime_t i_pts)
+{
+	MuteQueueExpire(p_queue, i_pts);
+	return (p_queue->i_count > 0) && (i_pts >= MuteQueueAt(p_queue, 0)->i_start);
+}
+
+// the mutes that [i_start, i_end) overlaps, in time order (whole, so the caller can tell where in them it is); usually none or one, from the head
+unsigned int MuteQueueOverlaps(mute_queue_t *p_queue, mtime_t i_start, mtime_t i_end, mute_interval_t *p_overlaps, unsigned int i_max)
+{
+	unsigned int i, i_found = 0;
+
+	MuteQueueExpire(p_queue, i_start);
+	for (i = 0; (i < p_queue->i_count) && (i_found < i_max); i++)
+	{
+		const mute_interval_t *p_interval = MuteQueueAt(p_queue, i);
+		if (p_interval->i_start >= i_end)
+			break;
+		p_overlaps[i_found++] = *p_interval;
+	}
+	return i_found;
+}
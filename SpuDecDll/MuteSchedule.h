@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * MuteSchedule.h : mute intervals shared by the demux, spu & audio decoders
+ *****************************************************************************/
+
+#ifndef MUTESCHEDULE_H
+#define MUTESCHEDULE_H
+
+// one per input: the demux creates it at open and publishes it on the input,
+// the decoders find it once when they open; all times are the audio pts the decoders see
+typedef struct mute_schedule_t mute_schedule_t;
+
+// who asked for the mute; each source has its own queue, and is the only one to push to it
+typedef enum
+{
+	MUTE_SOURCE_DEMUX,       // filter file mute entries
+	MUTE_SOURCE_SUBTITLE,    // spu decoder found a word
+	MUTE_SOURCE_EARLY_OCR,   // early ocr (in the demux) found a word
+	MUTE_SOURCE_MAX
+} mute_source_t;
+
+typedef struct
+{
+	mtime_t i_start;
+	mtime_t i_end;           // not included
+} mute_interval_t;
+
+// the audio decoder's mutes, in time order & not overlapping; circular
+#define MUTE_QUEUE_SIZE 64
+typedef struct
+{
+	mute_interval_t intervals[MUTE_QUEUE_SIZE];
+	unsigned int i_head;
+	unsigned int i_count;
+
+	// counters, for logging
+	unsigned int i_queued;
+	unsigned int i_merged;
+	unsigned int i_lost;     // queue full
+	unsigned int i_peak;
+} mute_queue_t;
+
+// demux: create & publish on the input, and unpublish & drop its reference at close
+mute_schedule_t *MuteScheduleCreate(vlc_object_t *p_input);
+void MuteScheduleDestroy(vlc_object_t *p_input, mute_schedule_t *p_sched);
+
+// decoders: find & hold the input's schedule (NULL if the demux isn't filtering), release at close
+mute_schedule_t *MuteScheduleGet(vlc_object_t *p_input);
+void MuteScheduleRelease(mute_schedule_t *p_sched);
+
+// producers, never wait; false if the source's queue is full & the mute was lost
+bool MuteSchedulePush(mute_schedule_t *p_sched, mute_source_t i_source, mtime_t i_start, mtime_t i_end);
+unsigned int MuteScheduleLost(mute_schedule_t *p_sched);
+
+// early ocr timing: both spu paths note each subtitle by its start time, matched up to see how much sooner early ocr had it
+// the spu decoder notes when it got the subtitle, early ocr when it was done & how long its ocr took (i_ocr)
+void MuteScheduleOcrNote(mute_schedule_t *p_sched, mute_source_t i_source, mtime_t i_start, mtime_t i_time, mtime_t i_ocr);
+unsigned int MuteScheduleOcrGain(mute_schedule_t *p_sched, mtime_t *pi_total);
+
+// consumer (audio decoder)
+void MuteQueueInit(mute_queue_t *p_queue);
+void MuteQueueFlush(mute_queue_t *p_queue);
+void MuteQueueCollect(mute_schedule_t *p_sched, mute_queue_t *p_queue);
+bool MuteQueueCovers(mute_queue_t *p_queue, mtime_t i_pts);
+unsigned int MuteQueueOverlaps(mute_queue_t *p_queue, mtime_t i_start, mtime_t i_end, mute_interval_t *p_overlaps, unsigned int i_max);
+
+#endif
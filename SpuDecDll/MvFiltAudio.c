@@ -36,6 +36,9 @@
 #include <vlc_aout.h>
 #include <vlc_codec.h>
 
+#include "MuteSchedule.h"
+#include "MuteKernel.h"
+
 
 
 /*****************************************************************************
@@ -52,10 +55,32 @@ struct decoder_sys_t
 {
 	decoder_t *p_subdec;
 	bool b_audiofilterEnable;
-	mtime_t saved_start_mute;
-	mtime_t saved_end_mute;
+	// mutes queued by the demux & spu decoders, and the ones we've taken from them, in time order
+	mute_schedule_t *p_mute;
+	mute_queue_t mute_queue;
+	// muting for the current output format (NULL: not one we know, so zeroed), and how long to fade in & out
+	mute_kernel_t pf_mute_kernel;
+	vlc_fourcc_t i_kernel_format;
+	int64_t i_ramp_ms;
+	// counters, logged at close
+	unsigned int i_blocks;
+	unsigned int i_muted;          // blocks with anything muted
+	unsigned int i_partial;        // ... of which only some samples
+	uint64_t i_muted_samples;
 };
 
+// how the samples are laid out in a decoded block
+typedef struct
+{
+	unsigned int i_rate;
+	unsigned int i_channels;
+	unsigned int i_sample_size;    // bytes, one channel
+	bool b_planar;                 // each channel's samples together, one plane after another
+} audio_layout_t;
+
+// most mutes one block can be cut by (a block is at most a few tens of ms)
+#define MUTE_BLOCK_OVERLAPS_MAX 4
+
 // need to keeps these routines in this module, cause the p_dec passed in is for this module; from here, we can call the subdec module
 static int DecodeAudio(decoder_t *p_dec, block_t *p_block)
 {
@@ -64,75 +89,120 @@ static int DecodeAudio(decoder_t *p_dec, block_t *p_block)
 
 static void Flush(decoder_t *p_dec)
 {
+	// seek, queued mutes are for timestamps that won't come now (demux queues them again if needed)
+	MuteQueueFlush(&p_dec->p_sys->mute_queue);
 	return p_dec->p_sys->p_subdec->pf_flush(p_dec->p_sys->p_subdec);
 }
 
-static int MyDecoderQueueAudio(decoder_t *p_dec, block_t *p_aout_buf)
+/*****************************************************************************
+ * muting part of a block
+ *****************************************************************************/
+// sample of the block at i_time; before the block is negative, after it is past i_nb_samples
+static int64_t BlockSampleAt(const block_t *p_block, unsigned int i_rate, mtime_t i_time)
 {
-	decoder_t * my_local_p_dec = (decoder_t *)p_dec->obj.parent; // local pointer is parent of subdecoder
-	mtime_t presentation_mtime;
-	mtime_t mute_start_time;
-	mtime_t mute_end_time;
-	mtime_t mute_start_time_absolute;
-	mtime_t mute_end_time_absolute;
+	return ((i_time - p_block->i_pts) * i_rate + CLOCK_FREQ / 2) / CLOCK_FREQ;
+}
 
-	// this comes from decoder_QueueAudio in vlc_codec.h
-	assert(p_aout_buf->p_next == NULL);
-	assert(my_local_p_dec->pf_queue_audio != NULL);
+// zero samples [i_first, i_last) of every channel, for formats without a mute kernel
+static void MuteSamples(block_t *p_block, const audio_layout_t *p_layout, unsigned int i_first, unsigned int i_last)
+{
+	if (p_layout->b_planar)
+	{
+		size_t i_plane = (size_t)p_block->i_nb_samples * p_layout->i_sample_size;
+		for (unsigned int i = 0; i < p_layout->i_channels; i++)
+		{
+			memset(p_block->p_buffer + i * i_plane + (size_t)i_first * p_layout->i_sample_size, 0,
+				(size_t)(i_last - i_first) * p_layout->i_sample_size);
+		}
+	}
+	else
+	{
+		size_t i_frame = (size_t)p_layout->i_channels * p_layout->i_sample_size;
+		memset(p_block->p_buffer + (size_t)i_first * i_frame, 0, (size_t)(i_last - i_first) * i_frame);
+	}
+}
 
-	// these global vars are how demux & spu dec queue mutes with this audio decoder
-	mute_start_time = var_GetInteger(my_local_p_dec->obj.parent, "mute_start_time");
-	mute_end_time = var_GetInteger(my_local_p_dec->obj.parent, "mute_end_time");
-	mute_start_time_absolute = var_GetInteger(my_local_p_dec->obj.parent, "mute_start_time_absolute");
-	mute_end_time_absolute = var_GetInteger(my_local_p_dec->obj.parent, "mute_end_time_absolute");
+// mute just the samples of the block that fall in queued mutes, rather than all or none of it by its pts
+static void MuteBlock(decoder_t *p_dec, decoder_sys_t *p_sys, block_t *p_block)
+{
+	const audio_format_t *p_fmt = &p_dec->fmt_out.audio;
+	mute_interval_t overlaps[MUTE_BLOCK_OVERLAPS_MAX];
+	audio_layout_t layout;
+	unsigned int i_overlaps;
+	unsigned int i_muted = 0;
 
-	// Note:  demux sends in mute requests with absoluate time, spudec with relative time
-	// would prefer to just use relative time, but don't know how to determine that in demux, yet
-	if (mute_start_time_absolute != LAST_MDATE)
+	// vlc 3 decoders (avcodec included) interleave before queueing, so planar never comes through here at the moment
+	layout.i_rate = p_fmt->i_rate;
+	layout.i_channels = p_fmt->i_channels;
+	layout.i_sample_size = p_fmt->i_bitspersample / 8;
+	layout.b_planar = false;
+
+	if ((layout.i_rate == 0) || (layout.i_channels == 0) || (layout.i_sample_size == 0) || (p_block->i_nb_samples == 0) ||
+		(p_block->i_buffer < (size_t)p_block->i_nb_samples * layout.i_channels * layout.i_sample_size))
 	{
-		/*
-		// check absoluate time first, and if a match, then convert to relative mtime
-		presentation_mtime = decoder_GetDisplayDate(p_dec, p_aout_buf->i_pts);
-		if (presentation_mtime > mute_start_time_absolute)
+		// can't tell where the samples are, all or nothing by the block's start
+		if (MuteQueueCovers(&p_sys->mute_queue, p_block->i_pts))
 		{
-			// convert to mtime instead (might conflict with spudec writing these vars, need to fix)
-			// maybe check for overlap and just extend window of mute if there is overlap??
-			mute_start_time = p_aout_buf->i_pts;
-			mute_end_time = mute_start_time + (mute_end_time_absolute - mute_start_time_absolute);
-			// tell demux we're finished queuing the mute
-			var_SetInteger(my_local_p_dec->obj.parent, "mute_start_time_absolute", mute_start_time_absolute); 
+			memset(p_block->p_buffer, 0, p_block->i_buffer);
+			p_sys->i_muted++;
 		}
-		*/
-		// testing...
-		my_local_p_dec->p_sys->saved_start_mute = mute_start_time_absolute;
-		my_local_p_dec->p_sys->saved_end_mute = mute_end_time_absolute;
-		// tell demux we're finished queuing the mute
-		var_SetInteger(my_local_p_dec->obj.parent, "mute_start_time_absolute", LAST_MDATE);
-
+		return;
 	}
 
-	// modify audio buffer before queueing
-	// if time falls within mute range, then clear out buf
-	if ((p_aout_buf->i_pts >= mute_start_time) && (p_aout_buf->i_pts < mute_end_time))
+	mtime_t i_end = p_block->i_pts + (mtime_t)p_block->i_nb_samples * CLOCK_FREQ / layout.i_rate;
+	i_overlaps = MuteQueueOverlaps(&p_sys->mute_queue, p_block->i_pts, i_end, overlaps, MUTE_BLOCK_OVERLAPS_MAX);
+	if (p_fmt->i_format != p_sys->i_kernel_format)
 	{
-		memset(p_aout_buf->p_buffer, 0, p_aout_buf->i_buffer);
+		p_sys->pf_mute_kernel = MuteKernelGet(p_fmt->i_format, layout.b_planar);
+		p_sys->i_kernel_format = p_fmt->i_format;
 	}
-	if ((p_aout_buf->i_pts >= my_local_p_dec->p_sys->saved_start_mute) && (p_aout_buf->i_pts < my_local_p_dec->p_sys->saved_end_mute))
+	for (unsigned int i = 0; i < i_overlaps; i++)
 	{
-		memset(p_aout_buf->p_buffer, 0, p_aout_buf->i_buffer);
+		mute_ramp_t ramp;
+		ramp.i_first = BlockSampleAt(p_block, layout.i_rate, overlaps[i].i_start);
+		ramp.i_last = BlockSampleAt(p_block, layout.i_rate, overlaps[i].i_end);
+		ramp.i_ramp = (unsigned int)__MIN(p_sys->i_ramp_ms * layout.i_rate / 1000, (ramp.i_last - ramp.i_first) / 2);
+
+		int64_t i_first = __MAX(ramp.i_first, 0);
+		int64_t i_last = __MIN(ramp.i_last, (int64_t)p_block->i_nb_samples);
+		if (i_last <= i_first)
+			continue;
+		if (p_sys->pf_mute_kernel != NULL)
+		{
+			p_sys->pf_mute_kernel(p_block->p_buffer, p_block->i_nb_samples, layout.i_channels, &ramp);
+		}
+		else
+		{
+			MuteSamples(p_block, &layout, (unsigned int)i_first, (unsigned int)i_last);
+		}
+		i_muted += (unsigned int)(i_last - i_first);
 	}
-	if (p_aout_buf->i_pts > my_local_p_dec->p_sys->saved_end_mute)
+	if (i_muted > 0)
 	{
-		// tell demux we're done muting
-		var_SetInteger(my_local_p_dec->obj.parent, "mute_end_time_absolute", LAST_MDATE);
+		p_sys->i_muted++;
+		if (i_muted < p_block->i_nb_samples)
+			p_sys->i_partial++;
+		p_sys->i_muted_samples += i_muted;
 	}
-	/*
-	else if (mute_end_time_absolute != LAST_MDATE) 
+}
+
+static int MyDecoderQueueAudio(decoder_t *p_dec, block_t *p_aout_buf)
+{
+	decoder_t * my_local_p_dec = (decoder_t *)p_dec->obj.parent; // local pointer is parent of subdecoder
+	decoder_sys_t *p_sys = my_local_p_dec->p_sys;
+
+	// this comes from decoder_QueueAudio in vlc_codec.h
+	assert(p_aout_buf->p_next == NULL);
+	assert(my_local_p_dec->pf_queue_audio != NULL);
+
+	// demux & spu dec queue mutes in the shared schedule; take any new ones into our queue
+	if (p_sys->p_mute != NULL)
 	{
-		// tell demux we're done muting
-		var_SetInteger(my_local_p_dec->obj.parent, "mute_end_time_absolute", LAST_MDATE);
+		MuteQueueCollect(p_sys->p_mute, &p_sys->mute_queue);
+		// modify audio buffer before queueing: clear out whatever falls within mute ranges
+		MuteBlock(p_dec, p_sys, p_aout_buf);
 	}
-	*/
+	p_sys->i_blocks++;
 	return my_local_p_dec->pf_queue_audio(p_dec, p_aout_buf);
 }
 
@@ -148,6 +218,13 @@ void EndAudioDec(vlc_object_t *obj)
 	decoder_sys_t *sys = p_dec->p_sys;
 	
 	msg_Info(p_dec, "unloading module.... \n");
+	if (sys->p_mute != NULL)
+	{
+		msg_Info(p_dec, "%u audio blocks, %u muted (%u partly, %llu samples); %u mutes queued, %u merged, most queued at once %u, %u lost (%u lost by sources)\n",
+			sys->i_blocks, sys->i_muted, sys->i_partial, (unsigned long long)sys->i_muted_samples, sys->mute_queue.i_queued, sys->mute_queue.i_merged, sys->mute_queue.i_peak,
+			sys->mute_queue.i_lost, MuteScheduleLost(sys->p_mute));
+	}
+	MuteScheduleRelease(sys->p_mute);
 	
 	module_unneed(sys->p_subdec, sys->p_subdec->p_module);
 	vlc_object_release(sys->p_subdec);
@@ -182,6 +259,15 @@ int InitAudioDec(vlc_object_t *obj)
 
 	// inherit variables
 	p_sys->b_audiofilterEnable = var_InheritBool(p_dec, "dvdsub-audio-filter");
+	p_sys->p_mute = NULL;
+	MuteQueueInit(&p_sys->mute_queue);
+	p_sys->pf_mute_kernel = NULL;
+	p_sys->i_kernel_format = 0;
+	p_sys->i_ramp_ms = __MAX(var_InheritInteger(p_dec, "dvdsub-mute-ramp"), 0);
+	p_sys->i_blocks = 0;
+	p_sys->i_muted = 0;
+	p_sys->i_partial = 0;
+	p_sys->i_muted_samples = 0;
 
 	// use local queue audtio function, so we can intercept these calls
 	// can determine whether or not to do this based on input var, to enable audio filter
@@ -199,6 +285,15 @@ int InitAudioDec(vlc_object_t *obj)
 	}
 
 	msg_Info(p_dec, "Made it HERE.... \n");
+	if (p_sys->b_audiofilterEnable == true)
+	{
+		// find the demux's mute schedule once, rather than looking up vars every block
+		p_sys->p_mute = MuteScheduleGet(p_dec->obj.parent);
+		if (var_InheritBool(p_dec, "dvdsub-mute-benchmark"))
+		{
+			MuteKernelBenchmark(VLC_OBJECT(p_dec));
+		}
+	}
 
 	p_dec->pf_decode = DecodeAudio;
 	p_dec->pf_flush = Flush;
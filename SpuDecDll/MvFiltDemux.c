@@ -26,6 +26,10 @@
 #endif
 
 #include "spudec.h"
+#include "FilterFile.h"
+#include "IfoIndex.h"
+#include "TimeMap.h"
+#include "MuteSchedule.h"
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
@@ -35,44 +39,439 @@
 #include <vlc_input.h>
 #include <vlc_variables.h>
 
-typedef struct
-{
-	wstring FilterType;
-	mtime_t starttime;
-	mtime_t endtime;
-	mtime_t duration; // somewhat redundant, but for simplicity when converting between dvd timescale & mpeg timestamps
-} FilterFileEntry;
+#include <atomic>
+
 // can this be moved to p_sys?
 // i think there are problems due to dynamic size
 static std::vector<FilterFileEntry> FilterFileArray;
+// interval index over FilterFileArray (which is sorted by start time):
+// FilterMaxEnd[i] is the latest end time of entries 0..i, so it never decreases and can be binary searched
+static std::vector<mtime_t> FilterMaxEnd;
+
+// root of the disc (eg. D:\), empty if not known
+static std::wstring DiscRoot;
+// for exact skip seeks; title that was last tried to be indexed, so one that can't be isn't retried on every skip
+static ifo_title_index_t TitleIndex;
+static int TitleIndexTried;
+
+// skipchapter & skiptitle entries, taken out of FilterFileArray (they have no times)
+static std::vector<FilterFileEntry> FilterNavArray;
+// longest title on the disc, what "main movie" chapter skips (no title given) apply to; 0 if not known
+static int MainTitle;
+
+// file sources: pts of the video keyframes seen so far (sorted), to seek straight to one after a skip
+static std::vector<mtime_t> KeyframeIndex;
+// only trust the index for a skip if the keyframes either side of the target are no further apart than this,
+// else there's probably a part that hasn't been played (& indexed) yet
+#define KEYFRAME_GAP_MAX 10000000
+
+// jumps in time bigger than this (or backwards) re-seek the cursor with a binary search, instead of walking it forward
+#define FILTER_CURSOR_RESEEK_TIME 5000000
+
+// playback position in FilterFileArray
+// i_next is the first entry whose FilterMaxEnd is after i_last_time, ie. every entry before it is over
+typedef struct
+{
+	size_t i_next;
+	mtime_t i_last_time;
+	bool b_reseek;             // i_last_time not set yet (index just built)
+#ifdef DEBUG_MVFILTDEMUX
+	unsigned int i_lookups;
+	unsigned int i_reseeks;
+	mtime_t i_index_time;
+	mtime_t i_linear_time;
+#endif
+} filter_cursor_t;
+
+// skip scheduling
+// a skip stops demuxing right before the skip range, lets the decoders play out what's already buffered,
+// then seeks (the seek flushes the decoders, so anything still buffered would be lost)
+typedef struct
+{
+	bool b_pending;            // demuxing stopped, waiting for decoders to drain
+	FilterFileEntry entry;
+	mtime_t i_target;          // demux time to seek to
+	mtime_t i_seek_from;       // compare time the skip was started at
+	mtime_t i_stop_time;       // mdate when demuxing stopped
+	mtime_t i_expected_drain;  // how long until what's buffered has played out
+	unsigned int i_polls;
+
+	// after the seek, until playback resumes
+	mtime_t i_seek_time;       // mdate seek was issued, 0 if none in flight
+	bool b_seek_landed;        // demux time has moved since the seek
+	bool b_rebuffering;        // es out has flushed & is buffering the new position
+
+	// how far compare time moves on each demux call, to stop before crossing into a skip
+	mtime_t i_last_compare;
+	mtime_t i_step;            // average
+
+	unsigned int i_skips;
+	mtime_t i_total_stall;
+	mtime_t i_total_latency;   // from demux stopping to playback resuming
+	unsigned int i_keyframe_seeks;
+} skip_state_t;
+
+// don't sleep longer than this at a time, so demux thread still handles controls (same as dvdnav DVDNAV_WAIT)
+#define SKIP_POLL_MAX 40000
+// polling interval once decoders should be nearly drained
+#define SKIP_POLL_MIN 5000
+// give up waiting for playback to resume (for stall measurement only) after
+#define SKIP_RESUME_TIMEOUT 10000000
+// largest step to look ahead by, larger jumps are seeks, not playback
+#define SKIP_LOOKAHEAD_MAX 1000000
+
+// es out ids are private, so remember what each one is as dvdnav adds them
+// dvd has at most 1 video, 8 audio & 32 spu streams (plus a few for menus)
+#define MAX_TRACKED_ES 64
+typedef struct
+{
+	es_out_id_t *es;
+	int i_cat;
+	vlc_fourcc_t i_codec;
+	int i_id;
+} tracked_es_t;
+
+// latest timestamps sent out, per category (UNKNOWN_ES slot is any stream)
+// written by demux thread in es out send, read without locking from the demux, spu tap & anywhere else
+typedef struct
+{
+	std::atomic<mtime_t> i_pts;
+	std::atomic<mtime_t> i_dts;
+} es_time_slot_t;
+static es_time_slot_t EsTimeSlots[SPU_ES + 1];
+
+// copies of input state, set from the input thread (intf-event callback) so the demux & es out hooks don't query vars per packet
+static std::atomic<bool> FiltersEnabled;  // same as Local_Enable_Filters var
+static std::atomic<bool> LengthChanged;   // demux length needs to be read again
+// filter file (& title index) loaded, by the load thread; nothing filter related is touched until it is
+static std::atomic<bool> FilterReady;
+
+// if the main feature starts before the filter file is loaded, hold it up this long (once) rather than play it unfiltered
+#define FILTER_LOAD_WAIT_MAX 5000000
+
+// how much time Demux takes, per second of playback
+typedef struct
+{
+	mtime_t i_total;       // in Demux, not counting waiting out skips
+	mtime_t i_subdemux;    // of which in dvdnav
+	mtime_t i_played;      // pts time demuxed
+	unsigned int i_calls;
+	// at last report
+	mtime_t i_report_total;
+	mtime_t i_report_played;
+	unsigned int i_report_calls;
+} demux_cost_t;
+
+// report every this much playback
+#define DEMUX_COST_REPORT 60000000
+
+// short skips are done by dropping the blocks in the skipped range as they're sent, instead of seeking;
+// everything sent after is moved back by the time dropped, so playback just carries on. times are pts as sent by the demux
+typedef struct
+{
+	mtime_t i_max;             // skips shorter than this are dropped, 0 = always seek
+	// range being dropped, i_end == 0 if none
+	mtime_t i_start;
+	mtime_t i_end;
+	mtime_t i_entry_start;     // filter entry it's for (filter file timescale), kept after it's done
+	bool b_entry_valid;
+	mtime_t i_offset;          // taken off every timestamp sent after ranges already done
+	bool b_dropping[SPU_ES + 1];      // last block of the category was dropped (for blocks without timestamps)
+	bool b_discontinuity[SPU_ES + 1]; // mark next block sent of the category
+	// after the range, video is held back until a picture that doesn't need the dropped ones
+	bool b_video_key_wait;
+	mtime_t i_video_key_deadline;
+
+	unsigned int i_skips;
+	unsigned int i_blocks;
+	mtime_t i_total;
+} drop_state_t;
+
+// give up waiting for a keyframe this long after the end of a dropped range
+#define DROP_KEY_WAIT_MAX 1000000
+
+// lookahead queue for early ocr: copies of the spu blocks, as they are demuxed, worked on by their own thread
+typedef struct
+{
+	demux_t      *p_demux;
+	block_fifo_t *p_fifo;
+	vlc_thread_t  thread;
+
+	vlc_mutex_t   lock;
+	es_format_t   fmt;           // spu track format (palette), protected by lock
+	bool          b_fmt_changed;
+
+	// only used by the thread
+	decoder_t    *p_dec;
+	unsigned int  i_subtitles;
+} spu_tap_t;
 
 struct demux_sys_t
 {
 	demux_t    * p_subdemux;
+	bool b_file;               // hosting a file demux (mkv, mp4, ts...), else dvdnav
 	bool b_videofilterEnable;
 	bool b_useDVDTimeScaleForTimestamps;
 	bool SpuES_Enable;
+	bool b_RenderEnable;
 	// potentially problems of declaring this here due to dynamic size
 	//std::vector<FilterFileEntry> FilterFileArray;
 
+	es_out_id_t *(*OriginalEsOutAdd)  (es_out_t *, const es_format_t *);
 	int(*OriginalEsOutSend)   (es_out_t *, es_out_id_t *, block_t *);
+	void(*OriginalEsOutDel)   (es_out_t *, es_out_id_t *);
+	int(*OriginalEsOutControl)(es_out_t *, int, va_list);
+
+	filter_cursor_t FilterCursor;
+	skip_state_t Skip;
+	drop_state_t Drop;
+
+	// title & seekpoint (chapter - 1) the sub demux was last seen at, for chapter/title skips
+	int i_nav_title;
+	int i_nav_seekpoint;
+	int i_nav_seekpoints;     // in that title, 0 if not known
+
+	// mutes for the audio decoder, shared with the decoders through the input
+	mute_schedule_t *p_mute;
+	FilterFileEntry *p_mute_entry;   // last mute entry queued, so each is only queued once
+
+	// background loading of the filter file, started at open
+	vlc_thread_t load_thread;
+	bool b_load_thread;
+	vlc_mutex_t load_lock;
+	vlc_cond_t load_wait;
+	bool b_load_waited;
+
+	// demux time & length, only read again when pts moves (or length changes)
+	mtime_t i_time;
+	int64_t i_length;
+	mtime_t i_time_pts;
+	demux_cost_t Cost;
+
+	tracked_es_t EsTable[MAX_TRACKED_ES];
+	int i_es;
+	int i_last_es;  // index of last one looked up, blocks usually come in runs from same stream
+
+	es_out_id_t * p_spu_es;  // spu track the filter uses, NULL until dvdnav adds it
+	spu_tap_t   * p_spu_tap; // NULL if early ocr disabled
 };
 
 static int Demux(demux_t *);
 static int Control(demux_t *, int, va_list);
-static bool sortByStart(const FilterFileEntry &lhs, const FilterFileEntry &rhs) { return lhs.starttime < rhs.starttime; }
+
+// build FilterMaxEnd & reset cursor, needs to be done each time FilterFileArray changes
+static void BuildFilterIndex(filter_cursor_t *p_cursor)
+{
+	mtime_t maxend = INT64_MIN;
+
+	FilterMaxEnd.clear();
+	FilterMaxEnd.reserve(FilterFileArray.size());
+	for (FilterFileEntry &n : FilterFileArray)
+	{
+		maxend = __MAX(maxend, n.endtime);
+		FilterMaxEnd.push_back(maxend);
+	}
+	memset(p_cursor, 0, sizeof(*p_cursor));
+	p_cursor->b_reseek = true;
+}
+
+static void SeekFilterCursor(filter_cursor_t *p_cursor, mtime_t time)
+{
+	p_cursor->i_next = std::upper_bound(FilterMaxEnd.begin(), FilterMaxEnd.end(), time) - FilterMaxEnd.begin();
+}
+
+// returns first entry (by start time) that time falls inside of, or NULL
+// normally called with slowly increasing time, so most calls just compare against start of next entry
+static FilterFileEntry * FindActiveFilter(demux_t *p_demux, mtime_t time)
+{
+	filter_cursor_t *p_cursor = &p_demux->p_sys->FilterCursor;
+	const size_t count = FilterFileArray.size();
+	FilterFileEntry *p_found = NULL;
+#ifdef DEBUG_MVFILTDEMUX
+	mtime_t start_time = mdate();
+#endif
+
+	if (p_cursor->b_reseek || (time < p_cursor->i_last_time) || (time - p_cursor->i_last_time > FILTER_CURSOR_RESEEK_TIME))
+	{
+		SeekFilterCursor(p_cursor, time);
+		p_cursor->b_reseek = false;
+#ifdef DEBUG_MVFILTDEMUX
+		p_cursor->i_reseeks++;
+#endif
+	}
+	else
+	{
+		while ((p_cursor->i_next < count) && (FilterMaxEnd[p_cursor->i_next] <= time))
+		{
+			p_cursor->i_next++;
+		}
+	}
+	p_cursor->i_last_time = time;
+
+	// common case, nothing started yet
+	if ((p_cursor->i_next < count) && (time > FilterFileArray[p_cursor->i_next].starttime))
+	{
+		// entries can overlap, so check all of the ones that have started
+		for (size_t i = p_cursor->i_next; (i < count) && (time > FilterFileArray[i].starttime); i++)
+		{
+			if (time < FilterFileArray[i].endtime)
+			{
+				p_found = &FilterFileArray[i];
+				break;
+			}
+		}
+	}
+
+#ifdef DEBUG_MVFILTDEMUX
+	// compare against the old linear search, for both result and cost
+	mtime_t mid_time = mdate();
+	FilterFileEntry *p_linear = NULL;
+	for (FilterFileEntry &n : FilterFileArray)
+	{
+		if ((time > n.starttime) && (time < n.endtime))
+		{
+			p_linear = &n;
+			break;
+		}
+	}
+	p_cursor->i_index_time += mid_time - start_time;
+	p_cursor->i_linear_time += mdate() - mid_time;
+	if (p_linear != p_found)
+	{
+		msg_Err(p_demux, "filter index mismatch at %lld", time);
+	}
+	if (++p_cursor->i_lookups % 10000 == 0)
+	{
+		msg_Dbg(p_demux, "filter lookups: %u, reseeks: %u, index: %lld us, linear: %lld us", p_cursor->i_lookups, p_cursor->i_reseeks, p_cursor->i_index_time, p_cursor->i_linear_time);
+	}
+#endif
+	return p_found;
+}
+
+// returns first skip that starts after time, but before time + i_lookahead, or NULL
+// uses the cursor of the last FindActiveFilter call, so call that first
+static FilterFileEntry * FindUpcomingSkip(demux_t *p_demux, mtime_t time, mtime_t i_lookahead)
+{
+	filter_cursor_t *p_cursor = &p_demux->p_sys->FilterCursor;
+
+	for (size_t i = p_cursor->i_next; (i < FilterFileArray.size()) && (FilterFileArray[i].starttime < time + i_lookahead); i++)
+	{
+		if ((FilterFileArray[i].FilterType == FILTER_SKIP) && (FilterFileArray[i].starttime >= time))
+		{
+			return &FilterFileArray[i];
+		}
+	}
+	return NULL;
+}
+
+static bool IsNavEntry(const FilterFileEntry &n)
+{
+	return (n.FilterType == FILTER_SKIP_CHAPTER) || (n.FilterType == FILTER_SKIP_TITLE);
+}
+
+// merge, pad & sort
+static void NormalizeFilterFile(demux_t * p_demux)
+{
+	filter_profile_t profile;
+	char *psz_profile = var_InheritString(p_demux, "dvdsub-filter-profile");
+
+	// only what the profile wants goes into the index, nothing is checked during playback
+	FilterProfileParse(VLC_OBJECT(p_demux), psz_profile, &profile);
+	free(psz_profile);
+	FilterFileApplyProfile(VLC_OBJECT(p_demux), FilterFileArray, &profile);
+
+	std::vector<FilterFileEntry>::iterator it = std::stable_partition(FilterFileArray.begin(), FilterFileArray.end(),
+		[](const FilterFileEntry &n) { return !IsNavEntry(n); });
+	FilterNavArray.assign(it, FilterFileArray.end());
+	FilterFileArray.erase(it, FilterFileArray.end());
+	if (!FilterNavArray.empty())
+	{
+		msg_Info(p_demux, "%u chapter/title skips\n", (unsigned int)FilterNavArray.size());
+	}
+
+	FilterFileNormalize(VLC_OBJECT(p_demux), FilterFileArray,
+		var_InheritInteger(p_demux, "dvdsub-filter-merge-gap") * 1000,
+		var_InheritInteger(p_demux, "dvdsub-filter-pre-pad") * 1000,
+		var_InheritInteger(p_demux, "dvdsub-filter-post-pad") * 1000);
+}
+
+// file sources have no disc to identify, so go by the name of the file (without folder & extension)
+static bool FilterNameForFile(demux_t * p_demux, std::wstring &name)
+{
+	wchar_t *psz_path = ToWide(p_demux->psz_file);
+
+	if (psz_path == NULL)
+	{
+		return false;
+	}
+	name = psz_path;
+	free(psz_path);
+	size_t i_slash = name.find_last_of(L"\\/");
+	if (i_slash != std::wstring::npos)
+	{
+		name.erase(0, i_slash + 1);
+	}
+	size_t i_dot = name.find_last_of(L'.');
+	if ((i_dot != std::wstring::npos) && (i_dot > 0))
+	{
+		name.erase(i_dot);
+	}
+	return true;
+}
+
+// for probing, every local file vlc opens comes through here: just look, don't load (or rebuild the library)
+static bool HasFilterFileForFile(demux_t * p_demux)
+{
+	std::wstring name;
+
+	if (!FilterNameForFile(p_demux, name))
+	{
+		return false;
+	}
+	return (GetFileAttributesW((L"FilterFiles\\" + name + L".txt").c_str()) != INVALID_FILE_ATTRIBUTES) ||
+		FilterLibraryHas(L"FilterFiles", name.c_str());
+}
+
+// library entry with the file's name as volume name, else FilterFiles\<name>.txt
+static void LoadFilterFileForFile(demux_t * p_demux)
+{
+	std::wstring name;
+	std::wstring filterfilename;
+
+	if (!FilterNameForFile(p_demux, name))
+	{
+		return;
+	}
+
+	if (FilterLibraryLoad(VLC_OBJECT(p_demux), L"FilterFiles", 0, 0, name.c_str(),
+		FilterFileArray, &p_demux->p_sys->b_useDVDTimeScaleForTimestamps) == VLC_SUCCESS)
+	{
+		msg_Info(p_demux, "Successfully loaded filter file from library for %S, %u entries\n", name.c_str(), (unsigned int)FilterFileArray.size());
+	}
+	else
+	{
+		filterfilename = L"FilterFiles\\" + name + L".txt";
+		if (FilterFileParse(VLC_OBJECT(p_demux), filterfilename.c_str(), FilterFileArray, &p_demux->p_sys->b_useDVDTimeScaleForTimestamps) != VLC_SUCCESS)
+		{
+			msg_Dbg(p_demux, "No filter file for %S\n", name.c_str());
+			return;
+		}
+		msg_Info(p_demux, "Successfully loaded filter file: %S, %u entries\n", filterfilename.c_str(), (unsigned int)FilterFileArray.size());
+	}
+	// "DVD" time for a file is just the demux time
+	NormalizeFilterFile(p_demux);
+}
 
 static void LoadFilterFile(demux_t * p_demux)
 {
-	std::vector<std::wstring> filterfile;
 	std::wstring filterfilename;
-	std::wstring cmdline;
-	std::wstring srttime;
-	mtime_t starttime_mt;
-	mtime_t endtime_mt;
+	wchar_t *psz_path;
+	uint64_t i_disc_id = 0;
+	bool b_volume = false;
 
 	// get name of dvdrom
 	WCHAR myDrives[105];
+	WCHAR rootPath[MAX_PATH];
 	WCHAR volumeName[MAX_PATH];
 	WCHAR fileSystemName[MAX_PATH];
 	DWORD serialNumber, maxComponentLen, fileSystemFlags;
@@ -80,85 +479,65 @@ static void LoadFilterFile(demux_t * p_demux)
 
 	FilterFileArray.clear();
 
-	// todo:  don't bother with index file...unless get to a very large number of filter files
-	// maybe just have the serial number in the filter files, for those movies
-	// where dvd/filename doesn't match, can scan through filter files looking for serial number matches
+	if (p_demux->p_sys->b_file)
+	{
+		LoadFilterFileForFile(p_demux);
+		return;
+	}
+
 	// Would prefer to just use volume name directly to identify the movie title and the filter file, but some (older?) movies don't define a useful volume name
-	//  sooo, instead, will first use serial number (assuming this is the same for all DVD's of the same movie?)
-	//  and will use an index file which will translate from the serial number to the movie title, which will be used to load the filter file.
-	//  if none found here, will try using volume name
+	//  sooo, the filter library (FilterFiles.bin, built from FilterFiles\) is searched by a hash of the disc's IFOs first, then serial number, then volume name.
+	//  if none found there, will try filter file named after the volume name directly
+	psz_path = ToWide(p_demux->psz_file);
+	if ((psz_path != NULL) && GetVolumePathNameW(psz_path, rootPath, ARRAYSIZE(rootPath)))
+	{
+		DiscRoot = rootPath;
+		i_disc_id = DiscIdCompute(rootPath);
+		msg_Info(p_demux, "  Disc ID: %016llX\n", i_disc_id);
+	}
 
-	// if couldn't match serial number, then try setting filename based on volume name
-	if (GetVolumeInformationW(ToWide(p_demux->psz_file), volumeName, ARRAYSIZE(volumeName), &serialNumber, &maxComponentLen, &fileSystemFlags, fileSystemName, ARRAYSIZE(fileSystemName)))
+	if ((psz_path != NULL) && GetVolumeInformationW(psz_path, volumeName, ARRAYSIZE(volumeName), &serialNumber, &maxComponentLen, &fileSystemFlags, fileSystemName, ARRAYSIZE(fileSystemName)))
 	{
+		b_volume = true;
 		msg_Info(p_demux, "  There is a CD/DVD in the drive:\n");
 		msg_Info(p_demux, "  Volume Name: %S\n", volumeName);
-		msg_Info(p_demux, "  Serial Number: %u\n", serialNumber);
+		msg_Info(p_demux, "  Serial Number: %08X\n", serialNumber);
 		msg_Info(p_demux, "  File System Name: %S\n", fileSystemName);
 		msg_Info(p_demux, "  Max Component Length: %lu\n", maxComponentLen);
 		filterfilename = volumeName;
 		filterfilename.append(L".txt");
-		filterfilename.erase(std::find(filterfilename.begin(), filterfilename.end(), L':'));
+		filterfilename.erase(std::remove(filterfilename.begin(), filterfilename.end(), L':'), filterfilename.end());
 	}
+	free(psz_path);
 
 	// use this folder for loading files
 	filterfilename = L"FilterFiles\\" + filterfilename;
-	msg_Info(p_demux, "Filter file Name: %S\n", filterfilename.c_str());
-	std::wifstream infile(filterfilename);
-	if (!infile)
+	if (FilterLibraryLoad(VLC_OBJECT(p_demux), L"FilterFiles", i_disc_id, b_volume ? serialNumber : 0, b_volume ? volumeName : NULL,
+		FilterFileArray, &p_demux->p_sys->b_useDVDTimeScaleForTimestamps) == VLC_SUCCESS)
 	{
-		msg_Info(p_demux, "Failed to load filter file: %S\n", filterfilename);
-		// at this point, should probably fail, since filter file was enabled, but file couldn't be loaded.
+		msg_Info(p_demux, "Successfully loaded filter file from library, %u entries\n", (unsigned int)FilterFileArray.size());
 	}
 	else
 	{
-		msg_Info(p_demux, "Successfully loaded filter file: %S\n", filterfilename);
+		msg_Info(p_demux, "Filter file Name: %S\n", filterfilename.c_str());
+		if (FilterFileParse(VLC_OBJECT(p_demux), filterfilename.c_str(), FilterFileArray, &p_demux->p_sys->b_useDVDTimeScaleForTimestamps) != VLC_SUCCESS)
+		{
+			msg_Info(p_demux, "Failed to load filter file: %S\n", filterfilename.c_str());
+			// at this point, should probably fail, since filter file was enabled, but file couldn't be loaded.
+		}
+		else
+		{
+			msg_Info(p_demux, "Successfully loaded filter file: %S, %u entries\n", filterfilename.c_str(), (unsigned int)FilterFileArray.size());
+		}
 	}
-	
-	// there's probably a better way to parse this...
-	// First line either ignore or use to define using DVD time scale for timestamps
-	// can ignore the result of this getline
-	std::getline(infile, cmdline);
-	// these are combinations that work:
+	// DVD_Timescale: these are combinations that work:
 	//  1.  stream mkv/mp4 with mpeg timestamps
 	//  2.  dvd with mpeg timestamps
 	//  3.  dvd with dvd time based timestamps
 	// the other option of streaming mkv/mp4 with dvd time based timestamps is not supported; there's no conversion without using actual DVD
-	if (cmdline == L"DVD_Timescale")
-	{
-		// TODO:  sanity check, make sure this demux module is using dvdnav, instead of streaming... else, illegal config.
-		// if (dvdnav==true)
-		{
-			p_demux->p_sys->b_useDVDTimeScaleForTimestamps = true;
-		}
-	}
-	else
-	{
-		p_demux->p_sys->b_useDVDTimeScaleForTimestamps = false;
-	}
-	// first getline gets command (mute/skip)
-	while (std::getline(infile, cmdline, L';'))
-	{
-		if ((cmdline == L"mute") || (cmdline == L"skip"))
-		{
-			// next getline gets srt start time
-			std::getline(infile, srttime, L' ');
-			// process start time
-			srttime_to_mtime(starttime_mt, srttime);
-
-			// get & throw away intermediate content on line, then get srt end time
-			std::getline(infile, srttime, L' ');
-			std::getline(infile, srttime);  // remainder of line should be the srt end time
+	// (files are loaded by LoadFilterFileForFile, where dvd time is taken as the file's own demux time)
 
-			// process endtime
-			srttime_to_mtime(endtime_mt, srttime);
-
-			FilterFileArray.push_back({ cmdline, starttime_mt, endtime_mt, (endtime_mt - starttime_mt) });
-
-		}
-	}
-	// sort the list by start time
-	std::sort(FilterFileArray.begin(), FilterFileArray.end(), sortByStart);
+	NormalizeFilterFile(p_demux);
 	//for (FilterFileEntry &n : FilterFileArray)
 	//{
 	//	msg_Info(p_demux, "type: %S, starttime: %lld\n", n.FilterType.c_str(), n.starttime);
@@ -178,7 +557,7 @@ static int EventCallback(vlc_object_t *p_this, char const *psz_cmd,
 	int spu_id;
 	bool Local_Enable_Filters;
 
-	Local_Enable_Filters = var_GetBool(p_demux->p_input, "Local_Enable_Filters");
+	Local_Enable_Filters = FiltersEnabled.load();
 
 	// ES pointer will change once actual movie starts
 // spu id 0 seems to be the desired one (english)
@@ -192,6 +571,9 @@ static int EventCallback(vlc_object_t *p_this, char const *psz_cmd,
 	{
 		length = var_GetInteger(p_input_thread, "length");
 		msg_Info(p_demux, "length changed: %lld", length);
+		// new title, dvd time starts over
+		TimeMapReset();
+		LengthChanged.store(true);
 		// if longer than ~15 minutes or so... then assume we've started actual movie
 		if (length > 900000000)
 		{
@@ -203,6 +585,7 @@ static int EventCallback(vlc_object_t *p_this, char const *psz_cmd,
 			Local_Enable_Filters = false;  // clear global var
 			p_demux->p_sys->SpuES_Enable = false;
 		}
+		FiltersEnabled.store(Local_Enable_Filters);
 		var_SetBool(p_demux->p_input, "Local_Enable_Filters", Local_Enable_Filters);
 	}
 	// ES event happens too many times prior to movie start, end up getting module loaded out of order
@@ -216,7 +599,8 @@ static int EventCallback(vlc_object_t *p_this, char const *psz_cmd,
 	if (Local_Enable_Filters)	// this means we've started main event
 	{
 		// now, on first movement of position, then enable the spu filter
-		if (input_event == INPUT_EVENT_POSITION)
+		// with early ocr, the demux reads the subtitles itself; only need the spu track if they should be shown
+		if ((input_event == INPUT_EVENT_POSITION) && ((p_demux->p_sys->p_spu_tap == NULL) || p_demux->p_sys->b_RenderEnable))
 		{
 			if (p_demux->p_sys->SpuES_Enable == false)
 			{
@@ -247,253 +631,1488 @@ static int EventCallback(vlc_object_t *p_this, char const *psz_cmd,
 // is there better way to grab this data?  dvd module demuxes & sends without making pointers to data available.
 // only doing this to get timestamp data out of packet
 static demux_t * p_LocalDemux;
-static mtime_t my_es_pts;
-static bool pts_changed=false;
-static int MyEsOutSend(es_out_t *out, es_out_id_t *es, block_t *p_block)
+
+static void EsTimeReset(void)
 {
-	// cannot determine which stream since es_out_id_t is private
-	// so, just grab the pts from any non-zero data, should be close enough?
-	pts_changed = false;
-	if (p_block->i_pts)
+	for (es_time_slot_t &slot : EsTimeSlots)
 	{
-		if (p_block->i_pts != my_es_pts)
-		{
-			pts_changed = true;
-		}
-		my_es_pts = p_block->i_pts;
+		slot.i_pts.store(0, std::memory_order_relaxed);
+		slot.i_dts.store(0, std::memory_order_relaxed);
 	}
-	p_LocalDemux->p_sys->OriginalEsOutSend(out, es, p_block);
+}
 
-	return VLC_SUCCESS;
+// latest pts sent out for the category, 0 if none yet
+static mtime_t EsLatestPts(int i_cat)
+{
+	return EsTimeSlots[i_cat].i_pts.load(std::memory_order_relaxed);
+}
+
+static mtime_t EsLatestDts(int i_cat)
+{
+	return EsTimeSlots[i_cat].i_dts.load(std::memory_order_relaxed);
 }
+
 static mtime_t GetRelativeDVDMtime(demux_t * p_demux)
 {
-	// this value should reflect the most recent timestamp from a stream sent out by dvd demux, so, should be closest approximation from current dvd position/time to relative mtime
-	return my_es_pts;
+	// closest approximation from current dvd position/time to relative mtime is the picture being demuxed
+	// audio & spu packets can be sent well ahead or behind of it, so only use them if there is no video
+	mtime_t i_pts = EsLatestPts(VIDEO_ES);
+	return (i_pts != 0) ? i_pts : EsLatestPts(UNKNOWN_ES);
 }
 
-/**
- * Initializes the raw dump pseudo-demuxer.
- */
-int DemuxOpen( vlc_object_t * p_this )
+// tracked es, NULL if not
+static tracked_es_t * EsLookup(demux_sys_t *p_sys, es_out_id_t *es)
 {
-    demux_t *p_demux = (demux_t*)p_this;
+	if ((p_sys->i_last_es < p_sys->i_es) && (p_sys->EsTable[p_sys->i_last_es].es == es))
+	{
+		return &p_sys->EsTable[p_sys->i_last_es];
+	}
+	for (int i = 0; i < p_sys->i_es; i++)
+	{
+		if (p_sys->EsTable[i].es == es)
+		{
+			p_sys->i_last_es = i;
+			return &p_sys->EsTable[i];
+		}
+	}
+	return NULL;
+}
 
-	demux_sys_t *p_sys = (demux_sys_t *)vlc_obj_malloc((vlc_object_t *)p_demux, sizeof(*p_sys));
-	p_demux->p_sys = p_sys;
+static void *SpuTapThread(void *p_data)
+{
+	spu_tap_t *p_tap = (spu_tap_t *)p_data;
+	mtime_t i_start;
 
-	if (unlikely(p_sys == NULL))
+	for (;;)
 	{
-		msg_Info(p_demux, "No MEM! \n");
-		return VLC_ENOMEM;
-	}
-	p_sys->p_subdemux = (demux_t *)vlc_object_create(p_demux, sizeof(*p_demux));
-	if (p_sys->p_subdemux == NULL)
-		return VLC_EGENERIC;
+		block_t *p_block = block_FifoGet(p_tap->p_fifo); // waits here, cancellation point
+		int canc = vlc_savecancel();
 
-	// copy contents of p_dec to subdec, excluding common stuff (in obj), which causes problems if that's overwritten
-	memcpy(((char *)p_sys->p_subdemux + sizeof(p_demux->obj)), ((char *)p_demux + sizeof(p_demux->obj)), (sizeof(demux_t) - sizeof(p_demux->obj)));
+		// (re)create decoder context when spu track changes, needs track palette
+		vlc_mutex_lock(&p_tap->lock);
+		if (p_tap->b_fmt_changed)
+		{
+			EarlyOcrDestroy(p_tap->p_dec);
+			p_tap->p_dec = EarlyOcrCreate(VLC_OBJECT(p_tap->p_demux->p_input), &p_tap->fmt);
+			p_tap->b_fmt_changed = false;
+		}
+		vlc_mutex_unlock(&p_tap->lock);
 
-	// now assign local p_sys;
-	p_demux->p_sys = p_sys;
+		if (p_tap->p_dec == NULL)
+		{
+			block_Release(p_block);
+		}
+		else if (EarlyOcrDecode(p_tap->p_dec, p_block, &i_start))
+		{
+			// how much sooner than the spu decoder it was checked is matched up in the mute schedule
+			p_tap->i_subtitles++;
+			msg_Dbg(p_tap->p_demux, "early ocr: subtitle at %lld checked", i_start);
+		}
+		vlc_restorecancel(canc);
+	}
+	vlc_assert_unreachable();
+	return NULL;
+}
 
-	// inherit vars
-	p_sys->b_videofilterEnable = var_InheritBool(p_demux, "dvdsub-video-filter");
+static spu_tap_t *SpuTapNew(demux_t *p_demux)
+{
+	spu_tap_t *p_tap = (spu_tap_t *)malloc(sizeof(*p_tap));
+	if (p_tap == NULL)
+		return NULL;
 
-	// load module
-	//// NEED to fix this to work with other module source than dvdnav (eg. mkv?)
-	p_sys->p_subdemux->p_module = module_need(p_sys->p_subdemux, "access_demux", "dvdnav", true);
-	if (p_sys->p_subdemux->p_module == NULL)
+	p_tap->p_demux = p_demux;
+	p_tap->p_fifo = block_FifoNew();
+	if (p_tap->p_fifo == NULL)
 	{
-		msg_Info(p_demux, "No MODULE! \n");
-		return VLC_EGENERIC;
+		free(p_tap);
+		return NULL;
 	}
+	vlc_mutex_init(&p_tap->lock);
+	es_format_Init(&p_tap->fmt, SPU_ES, VLC_CODEC_SPU);
+	p_tap->b_fmt_changed = false;
+	p_tap->p_dec = NULL;
+	p_tap->i_subtitles = 0;
 
-	msg_Info(p_demux, "Made it HERE.... \n");
-
-    p_demux->pf_demux = Demux;
-    p_demux->pf_control = Control;
+	if (vlc_clone(&p_tap->thread, SpuTapThread, p_tap, VLC_THREAD_PRIORITY_LOW))
+	{
+		es_format_Clean(&p_tap->fmt);
+		vlc_mutex_destroy(&p_tap->lock);
+		block_FifoRelease(p_tap->p_fifo);
+		free(p_tap);
+		return NULL;
+	}
+	return p_tap;
+}
 
-	// not sure if there may be a better way to do this...
-	// hook a custom routine for sending es packets, so we can snarf the data
-	p_LocalDemux = p_demux;
-	p_sys->OriginalEsOutSend = p_demux->out->pf_send;
-	p_demux->out->pf_send = MyEsOutSend;
+static void SpuTapDelete(spu_tap_t *p_tap)
+{
+	vlc_cancel(p_tap->thread);
+	vlc_join(p_tap->thread, NULL);
 
-	msg_Info(p_demux, "\n\nLoading filter file.\n\n");
-	LoadFilterFile(p_demux);
+	if (p_tap->i_subtitles)
+	{
+		msg_Info(p_tap->p_demux, "early ocr: %u subtitles", p_tap->i_subtitles);
+	}
+	EarlyOcrDestroy(p_tap->p_dec);
+	block_FifoRelease(p_tap->p_fifo);
+	es_format_Clean(&p_tap->fmt);
+	vlc_mutex_destroy(&p_tap->lock);
+	free(p_tap);
+}
 
-	// set up callback on any event change, to take action on different length or whatever needed
-	var_AddCallback(p_demux->p_input, "intf-event", EventCallback, p_demux); // pass in pointer to p_demux for es control
+static void KeyframeIndexAdd(mtime_t i_pts)
+{
+	if (i_pts <= VLC_TS_INVALID)
+	{
+		return;
+	}
+	// normally just playing forward
+	if (KeyframeIndex.empty() || (i_pts > KeyframeIndex.back()))
+	{
+		KeyframeIndex.push_back(i_pts);
+		return;
+	}
+	std::vector<mtime_t>::iterator it = std::lower_bound(KeyframeIndex.begin(), KeyframeIndex.end(), i_pts);
+	if (*it != i_pts)
+	{
+		KeyframeIndex.insert(it, i_pts);
+	}
+}
 
-	// Create some vars to be used by the filter decode modules
-	// all modules have access to input mod, so add these vars to that context
-	var_Create(p_demux->p_input, "Local_Enable_Filters", VLC_VAR_BOOL);
-	var_Create(p_demux->p_input, "mute_start_time", VLC_VAR_INTEGER);
-	var_Create(p_demux->p_input, "mute_end_time", VLC_VAR_INTEGER);
-	var_Create(p_demux->p_input, "mute_start_time_absolute", VLC_VAR_INTEGER);
-	var_Create(p_demux->p_input, "mute_end_time_absolute", VLC_VAR_INTEGER);
-	var_SetBool(p_demux->p_input, "Local_Enable_Filters", false);
-	var_SetInteger(p_demux->p_input, "mute_start_time", 0);
-	var_SetInteger(p_demux->p_input, "mute_end_time", 0);
-	var_SetInteger(p_demux->p_input, "mute_start_time_absolute", LAST_MDATE);
-	var_SetInteger(p_demux->p_input, "mute_end_time_absolute", 0);
+// first indexed keyframe at or after pts, if the index covers that part
+static bool KeyframeIndexFind(mtime_t i_pts, mtime_t *pi_keyframe)
+{
+	std::vector<mtime_t>::iterator it = std::lower_bound(KeyframeIndex.begin(), KeyframeIndex.end(), i_pts);
 
-    return VLC_SUCCESS;
+	if ((it == KeyframeIndex.begin()) || (it == KeyframeIndex.end()) || (*it - *(it - 1) > KEYFRAME_GAP_MAX))
+	{
+		return false;
+	}
+	*pi_keyframe = *it;
+	return true;
 }
 
-/**
- * Destroys the pseudo-demuxer.
- */
-void DemuxClose( vlc_object_t *p_this )
+/*****************************************************************************
+* short skips, dropped in the es out hooks
+*****************************************************************************/
+static void DropReset(drop_state_t *p_drop)
 {
-	demux_t *p_demux = (demux_t *)p_this;
-	demux_sys_t *sys = p_demux->p_sys;
-
-	msg_Info(p_demux, "unloading module.... \n");
+	p_drop->i_end = 0;
+	p_drop->i_offset = 0;
+	p_drop->b_entry_valid = false;
+	p_drop->b_video_key_wait = false;
+	memset(p_drop->b_dropping, 0, sizeof(p_drop->b_dropping));
+	memset(p_drop->b_discontinuity, 0, sizeof(p_drop->b_discontinuity));
+}
 
-	module_unneed(sys->p_subdemux, sys->p_subdemux->p_module);
-	vlc_object_release(sys->p_subdemux);
+// timestamp as it should be sent on, ie. moved back by what's been dropped before it
+static mtime_t DropRebase(const drop_state_t *p_drop, mtime_t i_time)
+{
+	if (i_time <= VLC_TS_INVALID)
+	{
+		return i_time;
+	}
+	if (p_drop->i_end != 0)
+	{
+		if (i_time >= p_drop->i_end)
+		{
+			return i_time - p_drop->i_offset - (p_drop->i_end - p_drop->i_start);
+		}
+		if (i_time >= p_drop->i_start)
+		{
+			return p_drop->i_start - p_drop->i_offset;
+		}
+	}
+	return i_time - p_drop->i_offset;
+}
+
+// pcr is past the end of the range, everything in it has gone by
+static void DropCheckDone(drop_state_t *p_drop, mtime_t i_pcr)
+{
+	if ((p_drop->i_end != 0) && (i_pcr >= p_drop->i_end))
+	{
+		p_drop->i_offset += p_drop->i_end - p_drop->i_start;
+		p_drop->i_total += p_drop->i_end - p_drop->i_start;
+		p_drop->i_skips++;
+		p_drop->i_end = 0;
+	}
+}
+
+// after a dropped range the video has to pick up at a keyframe, else the pictures that follow refer to dropped ones
+// mpeg-2 keyframes are found by their sequence header, others only if the demux flags them (which the keyframe index shows)
+static bool DropKeyframesKnown(demux_sys_t *p_sys)
+{
+	if (p_sys->i_es == 0)
+	{
+		return false;
+	}
+	for (int i = 0; i < p_sys->i_es; i++)
+	{
+		if ((p_sys->EsTable[i].i_cat == VIDEO_ES) && (p_sys->EsTable[i].i_codec != VLC_CODEC_MPGV) && KeyframeIndex.empty())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// start dropping the skip, if it's short enough. true if it's being (or has been) dropped, so no seek needed
+static bool DropArm(demux_t *p_demux, const FilterFileEntry *p_entry)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+	drop_state_t *p_drop = &p_sys->Drop;
+	mtime_t i_start, i_end;
+
+	if (p_drop->b_entry_valid && (p_drop->i_entry_start == p_entry->starttime))
+	{
+		return true;
+	}
+	// only one at a time, any other gets seeked over
+	if ((p_drop->i_end != 0) || ((p_entry->endtime - p_entry->starttime) >= p_drop->i_max))
+	{
+		return false;
+	}
+	// seek instead, that restarts the decoders cleanly
+	if (!DropKeyframesKnown(p_sys))
+	{
+		return false;
+	}
+	if (p_sys->b_useDVDTimeScaleForTimestamps)
+	{
+		if (!TimeMapDvdToPts(p_entry->starttime, &i_start) || !TimeMapDvdToPts(p_entry->endtime, &i_end))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		i_start = p_entry->starttime;
+		i_end = p_entry->endtime;
+	}
+	if (i_end <= i_start)
+	{
+		return false;
+	}
+	p_drop->i_start = i_start;
+	p_drop->i_end = i_end;
+	p_drop->i_entry_start = p_entry->starttime;
+	p_drop->b_entry_valid = true;
+	memset(p_drop->b_dropping, 0, sizeof(p_drop->b_dropping));
+	msg_Info(p_demux, "Dropping skip, starttime: %lld, duration: %lld, pts: %lld\n", p_entry->starttime, (p_entry->endtime - p_entry->starttime), i_start);
+	return true;
+}
+
+// picture that can be decoded without the ones before it
+static bool VideoBlockIsKey(vlc_fourcc_t i_codec, const block_t *p_block)
+{
+	if (p_block->i_flags & BLOCK_FLAG_TYPE_I)
+	{
+		return true;
+	}
+	// dvd demux doesn't flag them, but each GOP (& so each VOBU) starts with a sequence header
+	if (i_codec == VLC_CODEC_MPGV)
+	{
+		for (size_t i = 0; i + 3 < p_block->i_buffer; i++)
+		{
+			if ((p_block->p_buffer[i] == 0) && (p_block->p_buffer[i + 1] == 0) && (p_block->p_buffer[i + 2] == 1) && (p_block->p_buffer[i + 3] == 0xB3))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// drops (& releases) the block if it's in the range being skipped, else rebases it. true if dropped
+static bool DropBlock(demux_sys_t *p_sys, int i_cat, vlc_fourcc_t i_codec, block_t *p_block)
+{
+	drop_state_t *p_drop = &p_sys->Drop;
+	// video in decode order, so a picture isn't kept when one it refers to was dropped
+	mtime_t i_time = ((i_cat == VIDEO_ES) && (p_block->i_dts > VLC_TS_INVALID)) ? p_block->i_dts : p_block->i_pts;
+	bool b_drop;
+
+	if ((p_drop->i_end == 0) && (p_drop->i_offset == 0) && !p_drop->b_video_key_wait)
+	{
+		return false;
+	}
+	if (p_drop->i_end == 0)
+	{
+		b_drop = false;
+	}
+	else if (i_time <= VLC_TS_INVALID)
+	{
+		// rest of the last packet
+		b_drop = p_drop->b_dropping[i_cat];
+	}
+	else
+	{
+		b_drop = (i_time >= p_drop->i_start) && (i_time < p_drop->i_end);
+	}
+
+	// DropArm has checked keyframes can be found
+	if ((i_cat == VIDEO_ES) && b_drop && !p_drop->b_video_key_wait)
+	{
+		p_drop->b_video_key_wait = true;
+		p_drop->i_video_key_deadline = p_drop->i_end + DROP_KEY_WAIT_MAX;
+	}
+	else if ((i_cat == VIDEO_ES) && !b_drop && p_drop->b_video_key_wait)
+	{
+		if (VideoBlockIsKey(i_codec, p_block) || (i_time > p_drop->i_video_key_deadline))
+		{
+			p_drop->b_video_key_wait = false;
+		}
+		else
+		{
+			b_drop = true;
+		}
+	}
+
+	p_drop->b_dropping[i_cat] = b_drop;
+	if (b_drop)
+	{
+		p_drop->b_discontinuity[i_cat] = true;
+		p_drop->i_blocks++;
+		block_Release(p_block);
+		return true;
+	}
+	if (p_drop->b_discontinuity[i_cat])
+	{
+		p_drop->b_discontinuity[i_cat] = false;
+		p_block->i_flags |= BLOCK_FLAG_DISCONTINUITY;
+	}
+	p_block->i_pts = DropRebase(p_drop, p_block->i_pts);
+	p_block->i_dts = DropRebase(p_drop, p_block->i_dts);
+	return false;
+}
+
+// pass a control on to es out, for when the arguments need changing
+static int EsOutControlOriginal(es_out_t *out, int i_query, ...)
+{
+	va_list args;
+	int i_ret;
+
+	va_start(args, i_query);
+	i_ret = p_LocalDemux->p_sys->OriginalEsOutControl(out, i_query, args);
+	va_end(args);
+	return i_ret;
+}
+
+static int MyEsOutControl(es_out_t *out, int i_query, va_list args)
+{
+	demux_sys_t *p_sys = p_LocalDemux->p_sys;
+	drop_state_t *p_drop = &p_sys->Drop;
+	va_list ap;
+
+	switch (i_query)
+	{
+		case ES_OUT_SET_PCR:
+		case ES_OUT_SET_NEXT_DISPLAY_TIME:
+		{
+			va_copy(ap, args);
+			mtime_t i_pcr = va_arg(ap, int64_t);
+			va_end(ap);
+			if (i_query == ES_OUT_SET_PCR)
+			{
+				DropCheckDone(p_drop, i_pcr);
+			}
+			if ((p_drop->i_end != 0) || (p_drop->i_offset != 0))
+			{
+				return EsOutControlOriginal(out, i_query, DropRebase(p_drop, i_pcr));
+			}
+			break;
+		}
+		case ES_OUT_SET_GROUP_PCR:
+		{
+			va_copy(ap, args);
+			int i_group = va_arg(ap, int);
+			mtime_t i_pcr = va_arg(ap, int64_t);
+			va_end(ap);
+			DropCheckDone(p_drop, i_pcr);
+			if ((p_drop->i_end != 0) || (p_drop->i_offset != 0))
+			{
+				return EsOutControlOriginal(out, i_query, i_group, DropRebase(p_drop, i_pcr));
+			}
+			break;
+		}
+		case ES_OUT_RESET_PCR:
+			// seek or discontinuity, timestamps start over
+			DropReset(p_drop);
+			// and the audio decoder's queue is flushed, so if still in a mute entry, it's queued again
+			p_sys->p_mute_entry = NULL;
+			break;
+		default:
+			break;
+	}
+	return p_sys->OriginalEsOutControl(out, i_query, args);
+}
+
+static es_out_id_t *MyEsOutAdd(es_out_t *out, const es_format_t *p_fmt)
+{
+	demux_sys_t *p_sys = p_LocalDemux->p_sys;
+	es_out_id_t *es = p_sys->OriginalEsOutAdd(out, p_fmt);
+
+	if ((es != NULL) && (p_sys->i_es < MAX_TRACKED_ES))
+	{
+		tracked_es_t *p_track = &p_sys->EsTable[p_sys->i_es++];
+		p_track->es = es;
+		p_track->i_cat = p_fmt->i_cat;
+		p_track->i_codec = p_fmt->i_codec;
+		p_track->i_id = p_fmt->i_id;
+	}
+	else if (es != NULL)
+	{
+		msg_Warn(p_LocalDemux, "too many es to track, timestamps of id 0x%x not used", p_fmt->i_id);
+	}
+
+	// spu id 0 seems to be the desired one (english), same track the spu decoder filter uses
+	if ((es != NULL) && (p_fmt->i_cat == SPU_ES) && (p_fmt->i_codec == VLC_CODEC_SPU) && (p_fmt->i_id == SPU_ID_BASE))
+	{
+		p_sys->p_spu_es = es;
+		if (p_sys->p_spu_tap != NULL)
+		{
+			vlc_mutex_lock(&p_sys->p_spu_tap->lock);
+			es_format_Clean(&p_sys->p_spu_tap->fmt);
+			es_format_Copy(&p_sys->p_spu_tap->fmt, p_fmt);
+			p_sys->p_spu_tap->b_fmt_changed = true;
+			vlc_mutex_unlock(&p_sys->p_spu_tap->lock);
+		}
+	}
+	return es;
+}
+
+static void MyEsOutDel(es_out_t *out, es_out_id_t *es)
+{
+	demux_sys_t *p_sys = p_LocalDemux->p_sys;
+
+	if (es == p_sys->p_spu_es)
+	{
+		p_sys->p_spu_es = NULL;
+	}
+	for (int i = 0; i < p_sys->i_es; i++)
+	{
+		if (p_sys->EsTable[i].es == es)
+		{
+			// order doesn't matter, move last one into the hole
+			p_sys->EsTable[i] = p_sys->EsTable[--p_sys->i_es];
+			p_sys->i_last_es = 0;
+			break;
+		}
+	}
+	p_sys->OriginalEsOutDel(out, es);
+}
+
+static int MyEsOutSend(es_out_t *out, es_out_id_t *es, block_t *p_block)
+{
+	demux_sys_t *p_sys = p_LocalDemux->p_sys;
+
+	tracked_es_t *p_track = EsLookup(p_sys, es);
+	int i_cat = (p_track != NULL) ? p_track->i_cat : UNKNOWN_ES;
+	if (i_cat > SPU_ES)
+	{
+		i_cat = UNKNOWN_ES;
+	}
+	if (p_block->i_pts > VLC_TS_INVALID)
+	{
+		EsTimeSlots[i_cat].i_pts.store(p_block->i_pts, std::memory_order_relaxed);
+		EsTimeSlots[UNKNOWN_ES].i_pts.store(p_block->i_pts, std::memory_order_relaxed);
+	}
+	if (p_block->i_dts > VLC_TS_INVALID)
+	{
+		EsTimeSlots[i_cat].i_dts.store(p_block->i_dts, std::memory_order_relaxed);
+		EsTimeSlots[UNKNOWN_ES].i_dts.store(p_block->i_dts, std::memory_order_relaxed);
+	}
+	if (p_sys->b_file && (i_cat == VIDEO_ES) && (p_block->i_flags & BLOCK_FLAG_TYPE_I))
+	{
+		KeyframeIndexAdd((p_block->i_pts > VLC_TS_INVALID) ? p_block->i_pts : p_block->i_dts);
+	}
+
+	// short skip: dropped here, else rebased past any that were
+	if (DropBlock(p_sys, i_cat, (p_track != NULL) ? p_track->i_codec : 0, p_block))
+	{
+		return VLC_SUCCESS;
+	}
+
+	// early ocr: queue a copy of the subtitle, but only once main movie playing
+	if ((p_sys->p_spu_tap != NULL) && (es == p_sys->p_spu_es) && FiltersEnabled.load(std::memory_order_relaxed))
+	{
+		block_t *p_dup = block_Duplicate(p_block);
+		if (p_dup != NULL)
+		{
+			block_FifoPut(p_sys->p_spu_tap->p_fifo, p_dup);
+		}
+	}
+	p_sys->OriginalEsOutSend(out, es, p_block);
+
+	return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+* filter file loading, in the background
+*****************************************************************************/
+// everything filter related that's built at open: filter file, interval index & main title index (the disc i/o)
+static void FilterLoad(demux_t *p_demux)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+
+	if (!p_sys->b_file)
+	{
+		msg_Info(p_demux, "\n\nLoading filter file.\n\n");
+		LoadFilterFile(p_demux);
+	}
+	BuildFilterIndex(&p_sys->FilterCursor);
+	// index the main movie ahead of time, other titles are indexed when they have a skip
+	TitleIndexTried = 0;
+	MainTitle = 0;
+	if (!DiscRoot.empty() && (IfoTitleIndexLoad(VLC_OBJECT(p_demux), DiscRoot.c_str(), 0, &TitleIndex) == VLC_SUCCESS))
+	{
+		TitleIndexTried = TitleIndex.i_title;
+		MainTitle = TitleIndex.i_title;
+	}
+}
+
+static void *FilterLoadThread(void *p_data)
+{
+	demux_t *p_demux = (demux_t *)p_data;
+	demux_sys_t *p_sys = p_demux->p_sys;
+	mtime_t start_time = mdate();
+
+	FilterLoad(p_demux);
+
+	vlc_mutex_lock(&p_sys->load_lock);
+	FilterReady.store(true, std::memory_order_release);
+	vlc_cond_broadcast(&p_sys->load_wait);
+	vlc_mutex_unlock(&p_sys->load_lock);
+	msg_Info(p_demux, "Filter file loaded in background in %lld us (time no longer spent in open)\n", mdate() - start_time);
+	return NULL;
+}
+
+static void FilterLoadJoin(demux_sys_t *p_sys)
+{
+	if (p_sys->b_load_thread)
+	{
+		vlc_join(p_sys->load_thread, NULL);
+		p_sys->b_load_thread = false;
+	}
+}
+
+// filter file loaded? if the main feature has started without it, wait for it a while (once) rather than play unfiltered
+static bool FilterLoadReady(demux_t *p_demux)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+
+	if (FilterReady.load(std::memory_order_acquire))
+	{
+		return true;
+	}
+	if (!FiltersEnabled.load(std::memory_order_relaxed) || p_sys->b_load_waited)
+	{
+		return false;
+	}
+	p_sys->b_load_waited = true;
+
+	mtime_t start_time = mdate();
+	vlc_mutex_lock(&p_sys->load_lock);
+	while (!FilterReady.load(std::memory_order_acquire) && (vlc_cond_timedwait(&p_sys->load_wait, &p_sys->load_lock, start_time + FILTER_LOAD_WAIT_MAX) == 0))
+		;
+	vlc_mutex_unlock(&p_sys->load_lock);
+	msg_Info(p_demux, "Main feature started before filter file loaded, waited %lld us, %s\n", mdate() - start_time,
+		FilterReady.load() ? "loaded" : "still loading, unfiltered until it is");
+	return FilterReady.load(std::memory_order_acquire);
+}
+
+/**
+ * Wraps dvdnav, or for b_file, whichever demux would have opened the file.
+ */
+static int DemuxOpenHosted(demux_t *p_demux, bool b_file)
+{
+	mtime_t open_start = mdate();
+	demux_sys_t *p_sys = (demux_sys_t *)vlc_obj_malloc((vlc_object_t *)p_demux, sizeof(*p_sys));
+	p_demux->p_sys = p_sys;
+
+	if (unlikely(p_sys == NULL))
+	{
+		msg_Info(p_demux, "No MEM! \n");
+		return VLC_ENOMEM;
+	}
+	p_sys->b_file = b_file;
+	p_sys->b_load_thread = false;
+	p_sys->b_load_waited = false;
+	FilterReady.store(false);
+	// files only get wrapped if there's a filter file for them, let the normal demux have the rest
+	if (b_file)
+	{
+		LoadFilterFile(p_demux);
+		if (FilterFileArray.empty())
+		{
+			vlc_obj_free((vlc_object_t *)p_demux, p_sys);
+			return VLC_EGENERIC;
+		}
+	}
+	p_sys->p_subdemux = (demux_t *)vlc_object_create(p_demux, sizeof(*p_demux));
+	if (p_sys->p_subdemux == NULL)
+	{
+		FilterFileArray.clear();
+		vlc_obj_free((vlc_object_t *)p_demux, p_sys);
+		return VLC_EGENERIC;
+	}
+
+	// copy contents of p_dec to subdec, excluding common stuff (in obj), which causes problems if that's overwritten
+	memcpy(((char *)p_sys->p_subdemux + sizeof(p_demux->obj)), ((char *)p_demux + sizeof(p_demux->obj)), (sizeof(demux_t) - sizeof(p_demux->obj)));
+
+	// now assign local p_sys;
+	p_demux->p_sys = p_sys;
+
+	// inherit vars
+	p_sys->b_videofilterEnable = var_InheritBool(p_demux, "dvdsub-video-filter");
+	p_sys->b_RenderEnable = var_InheritBool(p_demux, "dvdsub-render-enable");
+	p_sys->p_spu_es = NULL;
+	p_sys->p_spu_tap = NULL;
+	p_sys->i_es = 0;
+	p_sys->i_last_es = 0;
+	EsTimeReset();
+	memset(&p_sys->Skip, 0, sizeof(p_sys->Skip));
+	memset(&p_sys->Cost, 0, sizeof(p_sys->Cost));
+	memset(&p_sys->Drop, 0, sizeof(p_sys->Drop));
+	p_sys->i_nav_title = -1;
+	p_sys->i_nav_seekpoint = -1;
+	p_sys->i_nav_seekpoints = 0;
+	p_sys->Drop.i_max = var_InheritInteger(p_demux, "dvdsub-skip-drop-max") * 1000;
+	p_sys->i_time = 0;
+	p_sys->i_length = 0;
+	p_sys->i_time_pts = 0;
+	FiltersEnabled.store(false);
+	LengthChanged.store(true);
+	TimeMapReset();
+	vlc_mutex_init(&p_sys->load_lock);
+	vlc_cond_init(&p_sys->load_wait);
+	// mutes go through the shared schedule, which the decoders find on the input
+	// (before the sub demux opens, as it may add the es the early ocr decoder is made for)
+	p_sys->p_mute = MuteScheduleCreate(VLC_OBJECT(p_demux->p_input));
+	p_sys->p_mute_entry = NULL;
+
+	// start on the filter file & word list now, so the disc i/o overlaps dvdnav opening & the menus, instead of holding up the first frame
+	// (for a file, the filter file has already been loaded to decide whether to take it)
+	if (b_file)
+	{
+		FilterLoad(p_demux);
+		FilterReady.store(true);
+	}
+	else if (vlc_clone(&p_sys->load_thread, FilterLoadThread, p_demux, VLC_THREAD_PRIORITY_LOW) == 0)
+	{
+		p_sys->b_load_thread = true;
+	}
+	else
+	{
+		FilterLoad(p_demux);
+		FilterReady.store(true);
+	}
+	if (var_InheritBool(p_demux, "dvdsub-audio-filter"))
+	{
+		WordListLoadStart(VLC_OBJECT(p_demux), true);
+	}
+
+	// not sure if there may be a better way to do this...
+	// hook a custom routine for sending es packets, so we can snarf the data
+	// (before the sub demux opens: file demuxes like mkv & mp4 add all their es in their open)
+	p_LocalDemux = p_demux;
+	if (var_InheritBool(p_demux, "dvdsub-early-ocr"))
+	{
+		p_sys->p_spu_tap = SpuTapNew(p_demux);
+	}
+	p_sys->OriginalEsOutAdd = p_demux->out->pf_add;
+	p_sys->OriginalEsOutSend = p_demux->out->pf_send;
+	p_sys->OriginalEsOutDel = p_demux->out->pf_del;
+	p_sys->OriginalEsOutControl = p_demux->out->pf_control;
+	p_demux->out->pf_add = MyEsOutAdd;
+	p_demux->out->pf_send = MyEsOutSend;
+	p_demux->out->pf_del = MyEsOutDel;
+	p_demux->out->pf_control = MyEsOutControl;
+
+	// load module
+	if (b_file)
+	{
+		// mark it, so DemuxOpenFile doesn't wrap the sub demux as well while it's probed
+		var_Create(p_sys->p_subdemux, "mvfilt-hosted", VLC_VAR_BOOL);
+		p_sys->p_subdemux->p_module = module_need(p_sys->p_subdemux, "demux", "any", false);
+	}
+	else
+	{
+		p_sys->p_subdemux->p_module = module_need(p_sys->p_subdemux, "access_demux", "dvdnav", true);
+	}
+	if (p_sys->p_subdemux->p_module == NULL)
+	{
+		msg_Info(p_demux, "No MODULE! \n");
+		p_demux->out->pf_add = p_sys->OriginalEsOutAdd;
+		p_demux->out->pf_send = p_sys->OriginalEsOutSend;
+		p_demux->out->pf_del = p_sys->OriginalEsOutDel;
+		p_demux->out->pf_control = p_sys->OriginalEsOutControl;
+		if (p_sys->p_spu_tap != NULL)
+		{
+			SpuTapDelete(p_sys->p_spu_tap);
+		}
+		p_LocalDemux = NULL;
+		FilterLoadJoin(p_sys);
+		WordListRelease();
+		if (p_sys->p_mute != NULL)
+		{
+			MuteScheduleDestroy(VLC_OBJECT(p_demux->p_input), p_sys->p_mute);
+		}
+		vlc_cond_destroy(&p_sys->load_wait);
+		vlc_mutex_destroy(&p_sys->load_lock);
+		if (b_file)
+		{
+			vlc_object_release(p_sys->p_subdemux);
+			FilterFileArray.clear();
+			vlc_obj_free((vlc_object_t *)p_demux, p_sys);
+		}
+		return VLC_EGENERIC;
+	}
+
+	msg_Info(p_demux, "Made it HERE.... \n");
+
+    p_demux->pf_demux = Demux;
+    p_demux->pf_control = Control;
+
+	// set up callback on any event change, to take action on different length or whatever needed
+	var_AddCallback(p_demux->p_input, "intf-event", EventCallback, p_demux); // pass in pointer to p_demux for es control
+
+	// Create some vars to be used by the filter decode modules
+	// all modules have access to input mod, so add these vars to that context
+	var_Create(p_demux->p_input, "Local_Enable_Filters", VLC_VAR_BOOL);
+	var_SetBool(p_demux->p_input, "Local_Enable_Filters", false);
+
+	msg_Info(p_demux, "Open took %lld us%s\n", mdate() - open_start, FilterReady.load() ? "" : ", filter file still loading");
+    return VLC_SUCCESS;
+}
+
+int DemuxOpen( vlc_object_t * p_this )
+{
+	return DemuxOpenHosted((demux_t *)p_this, false);
+}
+
+/**
+ * File sources (mkv, mp4, ts...): only takes them if there's a filter file, then hosts the real demux.
+ */
+int DemuxOpenFile(vlc_object_t *p_this)
+{
+	demux_t *p_demux = (demux_t *)p_this;
+
+	// being probed as our own sub demux, or already filtering something (filter state is global)
+	// preparsing (playlist, media info) mustn't take the filter state from the real playback
+	if ((var_Type(p_demux, "mvfilt-hosted") != 0) || (p_LocalDemux != NULL) || p_demux->b_preparsing)
+	{
+		return VLC_EGENERIC;
+	}
+	// need a local file name to look up the filter file
+	if ((p_demux->psz_file == NULL) ||
+		(!var_InheritBool(p_demux, "dvdsub-video-filter") && !var_InheritBool(p_demux, "dvdsub-audio-filter")))
+	{
+		return VLC_EGENERIC;
+	}
+	if (!HasFilterFileForFile(p_demux))
+	{
+		return VLC_EGENERIC;
+	}
+	return DemuxOpenHosted(p_demux, true);
+}
+
+/**
+ * Destroys the pseudo-demuxer.
+ */
+void DemuxClose( vlc_object_t *p_this )
+{
+	demux_t *p_demux = (demux_t *)p_this;
+	demux_sys_t *sys = p_demux->p_sys;
+	mute_schedule_t *p_mute = sys->p_mute;
+
+	msg_Info(p_demux, "unloading module.... \n");
+	var_DelCallback(p_demux->p_input, "intf-event", EventCallback, p_demux);
+	msg_Info(p_demux, "dvd time to pts map: %u pieces\n", TimeMapSegments());
+	if (sys->Skip.i_skips > 0)
+	{
+		msg_Info(p_demux, "%u skips, average visible stall %lld us, average latency %lld us, %u to indexed keyframe\n", sys->Skip.i_skips,
+			sys->Skip.i_total_stall / sys->Skip.i_skips, sys->Skip.i_total_latency / sys->Skip.i_skips, sys->Skip.i_keyframe_seeks);
+	}
+	if (sys->Drop.i_skips > 0)
+	{
+		msg_Info(p_demux, "%u short skips dropped (%lld ms, %u blocks)\n", sys->Drop.i_skips, sys->Drop.i_total / 1000, sys->Drop.i_blocks);
+	}
+	if (sys->Cost.i_played >= CLOCK_FREQ)
+	{
+		msg_Info(p_demux, "demux: %lld us per second of playback (%lld us in dvdnav), %u calls\n",
+			sys->Cost.i_total * CLOCK_FREQ / sys->Cost.i_played, sys->Cost.i_subdemux * CLOCK_FREQ / sys->Cost.i_played, sys->Cost.i_calls);
+	}
+
+	module_unneed(sys->p_subdemux, sys->p_subdemux->p_module);
+	// es out stays around after us, so put back original routines
+	p_demux->out->pf_add = sys->OriginalEsOutAdd;
+	p_demux->out->pf_send = sys->OriginalEsOutSend;
+	p_demux->out->pf_del = sys->OriginalEsOutDel;
+	p_demux->out->pf_control = sys->OriginalEsOutControl;
+	if (sys->p_spu_tap != NULL)
+	{
+		SpuTapDelete(sys->p_spu_tap);
+	}
+	vlc_object_release(sys->p_subdemux);
 	sys->p_subdemux->p_module = NULL;
+	FilterLoadJoin(sys);
+	vlc_cond_destroy(&sys->load_wait);
+	vlc_mutex_destroy(&sys->load_lock);
 	vlc_obj_free((vlc_object_t *)p_demux, sys);
+	FilterReady.store(false);
+	WordListRelease();
 	FilterFileArray.clear();
+	FilterNavArray.clear();
+	FilterMaxEnd.clear();
+	TitleIndex.i_title = 0;
+	TitleIndex.anchor_time.clear();
+	TitleIndex.cell_first.clear();
+	TitleIndex.cell_last.clear();
+	TitleIndex.anchor_offset.clear();
+	TitleIndex.vobu.clear();
+	DiscRoot.clear();
+	KeyframeIndex.clear();
+	p_LocalDemux = NULL;
 
 	var_Destroy(p_demux->p_input, "Local_Enable_Filters");
-	var_Destroy(p_demux->p_input, "mute_start_time");
-	var_Destroy(p_demux->p_input, "mute_end_time");
-	var_Destroy(p_demux->p_input, "mute_start_time_absolute");
-	var_Destroy(p_demux->p_input, "mute_end_time_absolute");
+	// decoders still holding it keep it until they close
+	if (p_mute != NULL)
+	{
+		mtime_t i_gain;
+		unsigned int i_matched = MuteScheduleOcrGain(p_mute, &i_gain);
+		if (i_matched > 0)
+		{
+			msg_Info(p_demux, "early ocr: %u subtitles also decoded by the spu decoder, checked %lld ms sooner on average\n", i_matched, (i_gain / i_matched) / 1000);
+		}
+		MuteScheduleDestroy(VLC_OBJECT(p_demux->p_input), p_mute);
+	}
 
 }
 
-static int Demux( demux_t *p_demux )
+/*****************************************************************************
+* chapter & title skips
+*****************************************************************************/
+static bool NavTitleMatches(int i_entry_title, int i_title)
 {
-	mtime_t timestamp;
-	mtime_t target_time = 0;
+	if (i_entry_title != 0)
+	{
+		return i_entry_title == i_title;
+	}
+	// main movie: the longest title if the disc could be indexed, else whatever is playing once filters are on
+	return (MainTitle != 0) ? (i_title == MainTitle) : FiltersEnabled.load(std::memory_order_relaxed);
+}
+
+static bool NavTitleSkipped(int i_title)
+{
+	for (const FilterFileEntry &n : FilterNavArray)
+	{
+		if ((n.FilterType == FILTER_SKIP_TITLE) && (n.i_title == i_title))
+			return true;
+	}
+	return false;
+}
+
+// chapters in the title, from the sub demux's title info; 0 if it can't tell
+static int NavSeekpointCount(demux_t *p_subdemux, int i_title)
+{
+	input_title_t **pp_title;
+	int i_titles, i_title_offset, i_seekpoint_offset;
+	int i_count = 0;
+
+	if (demux_Control(p_subdemux, DEMUX_GET_TITLE_INFO, &pp_title, &i_titles, &i_title_offset, &i_seekpoint_offset) != VLC_SUCCESS)
+	{
+		return 0;
+	}
+	if ((i_title >= 0) && (i_title < i_titles))
+	{
+		i_count = pp_title[i_title]->i_seekpoint;
+	}
+	for (int i = 0; i < i_titles; i++)
+	{
+		vlc_input_title_Delete(pp_title[i]);
+	}
+	free(pp_title);
+	return i_count;
+}
+
+// first seekpoint at or after i_seekpoint whose chapter isn't skipped, -1 if the rest of the title is
+static int NavNextSeekpoint(int i_title, int i_seekpoint, int i_seekpoints)
+{
+	bool b_skipped = true;
+
+	while (b_skipped)
+	{
+		if ((i_seekpoints > 0) && (i_seekpoint >= i_seekpoints))
+		{
+			return -1;
+		}
+		b_skipped = false;
+		for (const FilterFileEntry &n : FilterNavArray)
+		{
+			if ((n.FilterType == FILTER_SKIP_CHAPTER) && (n.i_chapter == i_seekpoint + 1) && NavTitleMatches(n.i_title, i_title))
+			{
+				b_skipped = true;
+				i_seekpoint++;
+				break;
+			}
+		}
+	}
+	return i_seekpoint;
+}
+
+// title to go to instead of a skipped one: the main movie, else the next title
+static int NavTitleTarget(int i_title)
+{
+	return ((MainTitle != 0) && (MainTitle != i_title)) ? MainTitle : (i_title + 1);
+}
+
+// after each demux: if the sub demux has just gone into a skipped chapter or title, jump past it with its own navigation,
+// which lands right on the chapter boundary (dvdnav keeps info up to date, so no control needed to see the change)
+static void NavCheck(demux_t *p_demux)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+	demux_t *p_subdemux = p_sys->p_subdemux;
+	int i_title = p_subdemux->info.i_title;
+	int i_seekpoint = p_subdemux->info.i_seekpoint;
+	int i_next;
+
+	if ((i_title == p_sys->i_nav_title) && (i_seekpoint == p_sys->i_nav_seekpoint))
+	{
+		return;
+	}
+	if (i_title != p_sys->i_nav_title)
+	{
+		p_sys->i_nav_seekpoints = NavSeekpointCount(p_subdemux, i_title);
+	}
+	p_sys->i_nav_title = i_title;
+	p_sys->i_nav_seekpoint = i_seekpoint;
+
+	// skipped title, or skipped chapters right through to its end: on to the next title
+	i_next = NavTitleSkipped(i_title) ? -1 : NavNextSeekpoint(i_title, i_seekpoint, p_sys->i_nav_seekpoints);
+	if (i_next < 0)
+	{
+		int i_target = NavTitleTarget(i_title);
+		msg_Info(p_demux, "Skipping title %d%s, to title %d\n", i_title, NavTitleSkipped(i_title) ? "" : " (rest of its chapters)", i_target);
+		if (demux_Control(p_subdemux, DEMUX_SET_TITLE, i_target) != VLC_SUCCESS)
+		{
+			msg_Warn(p_demux, "couldn't skip title %d\n", i_title);
+		}
+		return;
+	}
+	if (i_next != i_seekpoint)
+	{
+		msg_Info(p_demux, "Skipping title %d chapter %d, to chapter %d\n", i_title, i_seekpoint + 1, i_next + 1);
+		if (demux_Control(p_subdemux, DEMUX_SET_SEEKPOINT, i_next) != VLC_SUCCESS)
+		{
+			msg_Warn(p_demux, "couldn't skip chapter %d, no chapter after it?\n", i_seekpoint + 1);
+		}
+	}
+}
+
+/*****************************************************************************
+* skip scheduling
+*****************************************************************************/
+static void SkipStart(demux_t *p_demux, const FilterFileEntry *p_entry, mtime_t compare_value, mtime_t timestamp)
+{
+	skip_state_t *p_skip = &p_demux->p_sys->Skip;
+	mtime_t i_pcr_system;
+	mtime_t i_pts_delay = 0;
+
+	// todo:  not sure if added buffer needed anymore... not sure how frequently timer tick is updated
+	//// also note:  duration for dvd timescale will not exactly match mpeg timestamps, in particular for longer skips
+	//// might need to compensate for this
+	//// for now, using the diff between endtime & compare value to determine how much extra time to skip.
+	//// this scheme may result in effectively skipping multiple times for 1 desired "skip", but should hopefully cover the entire 
+	//// skip section, even if multiple jumps needed
+	p_skip->b_pending = true;
+	p_skip->entry = *p_entry;
+	if (p_demux->p_sys->b_useDVDTimeScaleForTimestamps)
+	{
+		p_skip->i_target = p_entry->endtime;
+	}
+	else if (!TimeMapPtsToDvd(p_entry->endtime, &p_skip->i_target))
+	{
+		p_skip->i_target = timestamp + (p_entry->endtime - compare_value);
+	}
+	p_skip->i_seek_from = compare_value;
+	p_skip->i_stop_time = mdate();
+	p_skip->i_polls = 0;
+
+	// what's buffered is about the delay between demux & playback, see the notes on time in Demux
+	if (es_out_Control(p_demux->out, ES_OUT_GET_PCR_SYSTEM, &i_pcr_system, &i_pts_delay) != VLC_SUCCESS)
+	{
+		i_pts_delay = 0;
+	}
+	p_skip->i_expected_drain = i_pts_delay;
+}
+
+// file demuxes have their own index (mkv cues, mp4 sync samples) & do precise seeks by starting at the keyframe before
+// the target, then hiding the pictures up to it. if the keyframe after the skip has already been seen, seek right to it instead,
+// so there's nothing to decode & hide
+static void SkipSeekFile(demux_t *p_demux)
+{
+	skip_state_t *p_skip = &p_demux->p_sys->Skip;
+	mtime_t i_target_pts, i_keyframe;
+	mtime_t i_time = p_skip->i_target;
+
+	if (TimeMapDvdToPts(p_skip->i_target, &i_target_pts) && KeyframeIndexFind(i_target_pts, &i_keyframe) &&
+		TimeMapPtsToDvd(i_keyframe, &i_time) && (i_time >= p_skip->i_target))
+	{
+		p_skip->i_keyframe_seeks++;
+		msg_Dbg(p_demux, "Skip seek to keyframe %lld us after target\n", i_keyframe - i_target_pts);
+	}
+	else
+	{
+		i_time = p_skip->i_target;
+	}
+	demux_Control(p_demux, DEMUX_SET_TIME, i_time, true);
+}
+
+// called instead of demuxing while a skip is pending
+static int SkipDrain(demux_t *p_demux, int64_t length)
+{
+	skip_state_t *p_skip = &p_demux->p_sys->Skip;
+	mtime_t elapsed = mdate() - p_skip->i_stop_time;
+	bool b_empty = false;
 	double newposition;
-	int64_t length;
+	int i_title = 0;
+	uint32_t i_sector;
+
+	// sleep until about when the decoders should be empty, rather than polling the whole time
+	if (elapsed + SKIP_POLL_MIN < p_skip->i_expected_drain)
+	{
+		msleep(__MIN(p_skip->i_expected_drain - elapsed - SKIP_POLL_MIN, SKIP_POLL_MAX));
+		return VLC_DEMUXER_SUCCESS;
+	}
+	es_out_Control(p_demux->out, ES_OUT_GET_EMPTY, &b_empty);
+	if (b_empty == false)
+	{
+		p_skip->i_polls++;
+		msleep(SKIP_POLL_MIN);
+		return VLC_DEMUXER_SUCCESS;
+	}
+
+	// playback has reached the skip, jump now
+	msg_Info(p_demux, "Skipping... starttime: %lld, duration: %lld, targettime: %lld, drained in %lld us (expected %lld us, %u polls)\n",
+		p_skip->entry.starttime, (p_skip->entry.endtime - p_skip->entry.starttime), p_skip->i_target, elapsed, p_skip->i_expected_drain, p_skip->i_polls);
+	p_skip->b_pending = false;
+	p_skip->i_seek_time = mdate();
+	p_skip->b_seek_landed = false;
+	p_skip->b_rebuffering = false;
+
+	if (p_demux->p_sys->b_file)
+	{
+		SkipSeekFile(p_demux);
+		return VLC_DEMUXER_SUCCESS;
+	}
+
+	// seek straight to the first VOBU at or after end of skip, if title could be indexed
+	if ((demux_Control(p_demux, DEMUX_GET_TITLE, &i_title) == VLC_SUCCESS) && !DiscRoot.empty() && (i_title != TitleIndexTried))
+	{
+		TitleIndexTried = i_title;
+		IfoTitleIndexLoad(VLC_OBJECT(p_demux), DiscRoot.c_str(), i_title, &TitleIndex);
+	}
+	if ((i_title == TitleIndex.i_title) && IfoTimeToPosition(&TitleIndex, p_skip->i_target, &newposition, &i_sector))
+	{
+		msg_Dbg(p_demux, "Skip seek to VOBU at sector %u\n", i_sector);
+	}
+	else
+	{
+		// setting position seemed to work better than time
+		newposition = (double)p_skip->i_target / (double)length;
+	}
+	// the precise flag has to be passed, Control reads it
+	demux_Control(p_demux, DEMUX_SET_POSITION, newposition, false);
+	return VLC_DEMUXER_SUCCESS;
+}
+
+// after a skip seek, watch for es out to finish buffering the new position, ie. the end of the visible stall
+static void SkipCheckResumed(demux_t *p_demux)
+{
+	skip_state_t *p_skip = &p_demux->p_sys->Skip;
+	mtime_t i_pcr_system, i_pts_delay;
+	mtime_t stall = mdate() - p_skip->i_seek_time;
+
+	if (es_out_Control(p_demux->out, ES_OUT_GET_PCR_SYSTEM, &i_pcr_system, &i_pts_delay) != VLC_SUCCESS)
+	{
+		p_skip->b_rebuffering = true;
+	}
+	else if (p_skip->b_rebuffering)
+	{
+		p_skip->i_skips++;
+		p_skip->i_total_stall += stall;
+		p_skip->i_total_latency += mdate() - p_skip->i_stop_time;
+		msg_Info(p_demux, "Skip done, playback resumed %lld us after seek, %lld us after demux stopped\n", stall, mdate() - p_skip->i_stop_time);
+		p_skip->i_seek_time = 0;
+		return;
+	}
+	if (stall > SKIP_RESUME_TIMEOUT)
+	{
+		msg_Dbg(p_demux, "Skip done, didn't see playback resume\n");
+		p_skip->i_seek_time = 0;
+	}
+}
+
+// refresh cached demux time & length, but only when the pts has moved (dvdnav time doesn't change any faster than that)
+static void DemuxUpdateTime(demux_t *p_demux, mtime_t relative_mtime)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+
+	if (LengthChanged.exchange(false))
+	{
+		demux_Control(p_demux, DEMUX_GET_LENGTH, &p_sys->i_length);
+	}
+	if ((relative_mtime == 0) || (relative_mtime != p_sys->i_time_pts))
+	{
+		demux_Control(p_demux, DEMUX_GET_TIME, &p_sys->i_time);
+		if ((relative_mtime > p_sys->i_time_pts) && (relative_mtime - p_sys->i_time_pts < SKIP_LOOKAHEAD_MAX))
+		{
+			p_sys->Cost.i_played += relative_mtime - p_sys->i_time_pts;
+		}
+		p_sys->i_time_pts = relative_mtime;
+	}
+}
+
+static void DemuxCostReport(demux_t *p_demux)
+{
+	demux_cost_t *p_cost = &p_demux->p_sys->Cost;
+	mtime_t played = p_cost->i_played - p_cost->i_report_played;
+
+	if (played < DEMUX_COST_REPORT)
+	{
+		return;
+	}
+	msg_Dbg(p_demux, "demux: %lld us per second of playback, %u calls\n",
+		(p_cost->i_total - p_cost->i_report_total) * CLOCK_FREQ / played, p_cost->i_calls - p_cost->i_report_calls);
+	p_cost->i_report_total = p_cost->i_total;
+	p_cost->i_report_played = p_cost->i_played;
+	p_cost->i_report_calls = p_cost->i_calls;
+}
+
+static int DemuxFiltered(demux_t *p_demux)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+	mtime_t timestamp;
 	es_out_t * myesout = p_demux->out;
 	bool Local_Enable_Filters;
 	mtime_t mute_start_time_absolute;
 	mtime_t mute_end_time_absolute;
 	mtime_t relative_mtime;
 	mtime_t compare_value;
-	mtime_t remaining_skip_time;
-	bool b_empty=false;
 	int returnval;
-	static bool wait_for_pts_change=false;
+	FilterFileEntry *p_entry;
+	skip_state_t *p_skip = &p_demux->p_sys->Skip;
 
 	// call demux first
-	returnval = p_demux->p_sys->p_subdemux->pf_demux(p_demux->p_sys->p_subdemux);
+	mtime_t i_subdemux_start = mdate();
+	returnval = p_sys->p_subdemux->pf_demux(p_sys->p_subdemux);
+	p_sys->Cost.i_subdemux += mdate() - i_subdemux_start;
 
 	// then do whatever other actions are necessary
 	if (returnval != VLC_EGENERIC)
 	{
-		mute_start_time_absolute = var_GetInteger(p_demux->p_input, "mute_start_time_absolute");
-		mute_end_time_absolute = var_GetInteger(p_demux->p_input, "mute_end_time_absolute");
-		Local_Enable_Filters = var_GetBool(p_demux->p_input, "Local_Enable_Filters");
+		Local_Enable_Filters = FiltersEnabled.load(std::memory_order_relaxed);
 
-		if ((p_demux->p_sys->b_videofilterEnable == true) && (Local_Enable_Filters == true) && (wait_for_pts_change == false))
+		if (p_skip->i_seek_time != 0)
+		{
+			SkipCheckResumed(p_demux);
+		}
+		if (!FilterLoadReady(p_demux))
+		{
+			return returnval;
+		}
+		if (!FilterNavArray.empty() && p_sys->b_videofilterEnable)
+		{
+			NavCheck(p_demux);
+		}
+		if ((p_demux->p_sys->b_videofilterEnable == true) && (Local_Enable_Filters == true))
 		{
-			demux_Control(p_demux, DEMUX_GET_LENGTH, &length);
-			demux_Control(p_demux, DEMUX_GET_TIME, &timestamp);
 			relative_mtime = GetRelativeDVDMtime(p_demux);
+			DemuxUpdateTime(p_demux, relative_mtime);
+			timestamp = p_sys->i_time;
 			compare_value = timestamp;
 			if (p_demux->p_sys->b_useDVDTimeScaleForTimestamps == false)
 			{
 				// in this case, want to compare against the relative mtime, as those values should match filter file values
 				compare_value = relative_mtime;
 			}
-			// there's probably a better way to search, but for now, search in order through all entries until find match.
-			for (FilterFileEntry &my_array_entry : FilterFileArray)
+
+			// don't look at filters again until the skip seek has taken effect, else would just skip again from old position
+			if ((p_skip->i_seek_time != 0) && (p_skip->b_seek_landed == false))
 			{
-				if ((compare_value > my_array_entry.starttime) && (compare_value < my_array_entry.endtime))
+				if (compare_value == p_skip->i_seek_from)
 				{
-					if (my_array_entry.FilterType == L"skip")
-					{
-						// stop demuxing and wait until es is empty, then jump to target
-						es_out_Control(p_demux->out, ES_OUT_GET_EMPTY, &b_empty);
-						if (b_empty == false)
-						{
-							// seems this sleep might be necessary; got this value from dvdnav DVDNAV_WAIT case
-							msleep(40000);
-							return returnval;  // return here and skip actual demuxing
-						}
+					return returnval;
+				}
+				p_skip->b_seek_landed = true;
+				p_skip->i_last_compare = compare_value;
+			}
+
+			// samples for the dvd time <-> pts map, once any skip seek has settled
+			if ((relative_mtime != 0) && ((p_skip->i_seek_time == 0) || p_skip->b_seek_landed))
+			{
+				TimeMapLearn(timestamp, relative_mtime);
+			}
+
+			// track how far compare time moves each time it changes (average), to know if the next one would cross into a skip
+			if ((compare_value > p_skip->i_last_compare) && (compare_value - p_skip->i_last_compare < SKIP_LOOKAHEAD_MAX))
+			{
+				p_skip->i_step = (p_skip->i_step * 7 + (compare_value - p_skip->i_last_compare)) / 8;
+			}
+			p_skip->i_last_compare = compare_value;
 
-						// maybe better way to do this
+			p_entry = FindActiveFilter(p_demux, compare_value);
+			if ((p_entry != NULL) && (p_entry->FilterType == FILTER_SKIP) && DropArm(p_demux, p_entry))
+			{
+				// short skip, being dropped as it's sent
+				p_entry = NULL;
+			}
+			if ((p_entry == NULL) || (p_entry->FilterType != FILTER_SKIP))
+			{
+				// short skip coming up, start dropping it before any of it is sent
+				FilterFileEntry *p_upcoming = FindUpcomingSkip(p_demux, compare_value, SKIP_LOOKAHEAD_MAX);
+				if ((p_upcoming != NULL) && DropArm(p_demux, p_upcoming))
+				{
+					p_upcoming = NULL;
+				}
+				// next step would most likely land inside a skip (more than half way in), so stop now rather than sending the start of the skipped part
+				if ((p_upcoming != NULL) && (p_upcoming->starttime < compare_value + p_skip->i_step / 2))
+				{
+					p_entry = p_upcoming;
+				}
+			}
+			if (p_entry != NULL)
+			{
+				FilterFileEntry &my_array_entry = *p_entry;
+				if (my_array_entry.FilterType == FILTER_SKIP)
+				{
+					// stop demuxing and wait until es is empty, then jump to target
+					msg_Dbg(p_demux, "Skip ahead, timestamp: %lld, relativemtime: %lld, starttime: %lld, video dts: %lld, audio pts: %lld\n", timestamp, relative_mtime, my_array_entry.starttime, EsLatestDts(VIDEO_ES), EsLatestPts(AUDIO_ES));
+					SkipStart(p_demux, &my_array_entry, compare_value, timestamp);
+				}
+				else if (my_array_entry.FilterType == FILTER_BLUR)
+				{
+				}
+				else if (my_array_entry.FilterType == FILTER_MUTE)
+				{
+					// queue each mute entry once, when it's reached; the audio decoder holds as many as are queued
+					if ((p_sys->p_mute != NULL) && (p_sys->p_mute_entry != p_entry))
+					{
+						// TODO:  Need to get proper conversion from time to mtime.  for now, treating delta time same as delta mtime
+						// get current mtime (assuming need to mute soon) using input thread... not sure if better way to do this
+						// only get absolute time from PCR SYSTEM; don't have origin, not sure how to calculate offset
+						//demux_Control(p_demux, DEMUX_GET_PTS_DELAY, &pts_delay);
+//						input_Control(p_input_thread, INPUT_GET_PCR_SYSTEM, &pi_system, &pi_delay);
+//						mtime_time = mdate();
+						//input_Control(p_input_thread, INPUT_GET_TIME, &inputtime);
+						//timevartime = var_GetInteger(p_input_thread, "time");
+						//es_out_Control(myesout, ES_OUT_GET_PCR_SYSTEM, &estime1, &estime2);
+						// here's what i can see from time vars:
+						///  demux time:  relative time, from perspective of demux (ahead of input thread)
+						///  demux pts:  presentation time delay from demux, this seems constant @ 300ms
+						///  mdate:  absolute time value
+						///  pi_system:  also absolute time value, but seems seconds different than mdate, where the diff is not constant.  don't understand...
+						///  pi_delay:  delay from demux time to input thread time
+						///  input time:  relative time as seen from input thread
+						///  timevar:  same as input time
+						///  estime1:  same as pi_system
+						///  estime2:  same as pi_delay
+						// possible that diff between mdate & pi_system is how to convert between time & mtime?
+						//msg_Info(p_demux, "demux_time: %lld, demux_pts: %lld, mdate: %lld, pi_system: %lld, pi_delay: %lld, inputtime: %lld, timevar: %lld, estime1: %lld, estime2: %lld", timestamp, pts_delay, mtime_time, pi_system, pi_delay, inputtime, timevartime, estime1, estime2);
+						// pi_system is absoluate time, note that it does not match mdate value
+//						mute_end_time_absolute = mtime_time + pi_delay + (my_array_entry.endtime - timestamp);
+//						mute_start_time_absolute = mtime_time + pi_delay; // writing to this var triggers audio filter to queue mute
 						if (p_demux->p_sys->b_useDVDTimeScaleForTimestamps == false)
 						{
-							wait_for_pts_change = true;
+							// filter file times are pts already
+							mute_start_time_absolute = my_array_entry.starttime;
+							mute_end_time_absolute = my_array_entry.endtime;
 						}
-
-						// todo:  not sure if added buffer needed anymore... not sure how frequently timer tick is updated
-						//// also note:  duration for dvd timescale will not exactly match mpeg timestamps, in particular for longer skips
-						//// might need to compensate for this
-						//// for now, using the diff between endtime & compare value to determine how much extra time to skip.
-						//// this scheme may result in effectively skipping multiple times for 1 desired "skip", but should hopefully cover the entire 
-						//// skip section, even if multiple jumps needed
-						remaining_skip_time = my_array_entry.endtime - compare_value;
-						target_time = timestamp + remaining_skip_time;
-						msg_Info(p_demux, "Skipping... timestamp: %lld, relativemtime: %lld, targettime: %lld, starttime: %lld, duration: %lld\n", timestamp, relative_mtime, target_time, my_array_entry.starttime, my_array_entry.duration);
-						// setting position seemed to work better than time
-						newposition = (double)target_time / (double)length;
-						demux_Control(p_demux, DEMUX_SET_POSITION, newposition);
-					}
-					else if (my_array_entry.FilterType == L"blur")
-					{
-					}
-					else if (my_array_entry.FilterType == L"mute")
-					{
-						// 2 var handshake with audio decoder: start indicates to queue start and end indicates mute is finished
-						if ((mute_start_time_absolute == LAST_MDATE) && (mute_end_time_absolute == LAST_MDATE))
+						else if (!TimeMapDvdToPts(my_array_entry.starttime, &mute_start_time_absolute) ||
+							!TimeMapDvdToPts(my_array_entry.endtime, &mute_end_time_absolute))
 						{
-							// TODO:  Need to get proper conversion from time to mtime.  for now, treating delta time same as delta mtime
-							// get current mtime (assuming need to mute soon) using input thread... not sure if better way to do this
-							// only get absolute time from PCR SYSTEM; don't have origin, not sure how to calculate offset
-							//demux_Control(p_demux, DEMUX_GET_PTS_DELAY, &pts_delay);
-	//						input_Control(p_input_thread, INPUT_GET_PCR_SYSTEM, &pi_system, &pi_delay);
-	//						mtime_time = mdate();
-							//input_Control(p_input_thread, INPUT_GET_TIME, &inputtime);
-							//timevartime = var_GetInteger(p_input_thread, "time");
-							//es_out_Control(myesout, ES_OUT_GET_PCR_SYSTEM, &estime1, &estime2);
-							// here's what i can see from time vars:
-							///  demux time:  relative time, from perspective of demux (ahead of input thread)
-							///  demux pts:  presentation time delay from demux, this seems constant @ 300ms
-							///  mdate:  absolute time value
-							///  pi_system:  also absolute time value, but seems seconds different than mdate, where the diff is not constant.  don't understand...
-							///  pi_delay:  delay from demux time to input thread time
-							///  input time:  relative time as seen from input thread
-							///  timevar:  same as input time
-							///  estime1:  same as pi_system
-							///  estime2:  same as pi_delay
-							// possible that diff between mdate & pi_system is how to convert between time & mtime?
-							//msg_Info(p_demux, "demux_time: %lld, demux_pts: %lld, mdate: %lld, pi_system: %lld, pi_delay: %lld, inputtime: %lld, timevar: %lld, estime1: %lld, estime2: %lld", timestamp, pts_delay, mtime_time, pi_system, pi_delay, inputtime, timevartime, estime1, estime2);
-							// pi_system is absoluate time, note that it does not match mdate value
-	//						mute_end_time_absolute = mtime_time + pi_delay + (my_array_entry.endtime - timestamp);
-	//						mute_start_time_absolute = mtime_time + pi_delay; // writing to this var triggers audio filter to queue mute
-							mute_end_time_absolute = relative_mtime + my_array_entry.duration;
-							mute_start_time_absolute = relative_mtime; // writing to this var triggers audio filter to queue mute
-							// must set end, first
-							var_SetInteger(p_demux->p_input, "mute_end_time_absolute", mute_end_time_absolute);
-							var_SetInteger(p_demux->p_input, "mute_start_time_absolute", mute_start_time_absolute);
-							msg_Info(p_demux, "Muting... timestamp: %lld, relativemtime: %lld, targettime: %lld, starttime: %lld, duration: %lld\n", timestamp, relative_mtime, mute_start_time_absolute, my_array_entry.starttime, my_array_entry.duration);
+							// no map yet, mute from the audio being sent out now
+							mtime_t audio_pts = EsLatestPts(AUDIO_ES);
+							if (audio_pts == 0)
+							{
+								audio_pts = relative_mtime;
+							}
+							mute_end_time_absolute = audio_pts + (my_array_entry.endtime - my_array_entry.starttime);
+							mute_start_time_absolute = audio_pts;
 						}
+						// audio decoder sees timestamps after any short skips were dropped
+						mute_start_time_absolute = DropRebase(&p_demux->p_sys->Drop, mute_start_time_absolute);
+						mute_end_time_absolute = DropRebase(&p_demux->p_sys->Drop, mute_end_time_absolute);
+						MuteSchedulePush(p_sys->p_mute, MUTE_SOURCE_DEMUX, mute_start_time_absolute, mute_end_time_absolute);
+						p_sys->p_mute_entry = p_entry;
+						msg_Info(p_demux, "Muting... timestamp: %lld, relativemtime: %lld, targettime: %lld, starttime: %lld, duration: %lld\n", timestamp, relative_mtime, mute_start_time_absolute, my_array_entry.starttime, (my_array_entry.endtime - my_array_entry.starttime));
 					}
-					break; // out of for loop
 				}
 			}
 		}
-		if (pts_changed == true)
+	}
+
+	return returnval;
+
+}
+
+static int Demux( demux_t *p_demux )
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+
+	// skip pending:  don't demux any further into it, just wait for decoders to play out & then seek
+	if (p_sys->Skip.b_pending)
+	{
+		return SkipDrain(p_demux, p_sys->i_length);
+	}
+
+	mtime_t i_start = mdate();
+	int returnval = DemuxFiltered(p_demux);
+	p_sys->Cost.i_total += mdate() - i_start;
+	p_sys->Cost.i_calls++;
+	DemuxCostReport(p_demux);
+	return returnval;
+}
+
+/*****************************************************************************
+* seek interception
+*****************************************************************************/
+// skip entry that time (filter file timescale) is inside of, following on through any skip that its end lands in; NULL if none
+static FilterFileEntry * FindSkipAt(mtime_t time)
+{
+	FilterFileEntry *p_found = NULL;
+	size_t i = std::upper_bound(FilterMaxEnd.begin(), FilterMaxEnd.end(), time) - FilterMaxEnd.begin();
+
+	for (; (i < FilterFileArray.size()) && (FilterFileArray[i].starttime <= time); i++)
+	{
+		if ((FilterFileArray[i].FilterType == FILTER_SKIP) && (FilterFileArray[i].endtime > time))
 		{
-			wait_for_pts_change == false;
+			p_found = &FilterFileArray[i];
+			time = p_found->endtime;
 		}
 	}
+	return p_found;
+}
 
-	return returnval;
+// seek target is dvd time; if it lands in a skip, move it to the end of the skip (& cursor along with it)
+// returns false if seek doesn't need changing
+static bool SeekPastSkip(demux_t *p_demux, mtime_t *pi_time)
+{
+	demux_sys_t *p_sys = p_demux->p_sys;
+	mtime_t compare_value = *pi_time;
+	FilterFileEntry *p_entry;
+
+	if (!p_sys->b_videofilterEnable || !FiltersEnabled.load(std::memory_order_relaxed) || !FilterReady.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+	// filter file in pts, compare there
+	if (!p_sys->b_useDVDTimeScaleForTimestamps && !TimeMapDvdToPts(*pi_time, &compare_value))
+	{
+		return false;
+	}
+	p_entry = FindSkipAt(compare_value);
+	if (p_entry == NULL)
+	{
+		return false;
+	}
+	if (p_sys->b_useDVDTimeScaleForTimestamps)
+	{
+		*pi_time = p_entry->endtime;
+	}
+	else if (!TimeMapPtsToDvd(p_entry->endtime, pi_time))
+	{
+		*pi_time += p_entry->endtime - compare_value;
+	}
+	msg_Info(p_demux, "Seek into skip, starttime: %lld, endtime: %lld, moved to: %lld\n", p_entry->starttime, p_entry->endtime, *pi_time);
 
+	// next demux should carry on from the end of the skip; any skip that was about to be done is replaced by this seek
+	SeekFilterCursor(&p_sys->FilterCursor, p_entry->endtime);
+	p_sys->FilterCursor.i_last_time = p_entry->endtime;
+	p_sys->Skip.b_pending = false;
+	p_sys->Skip.i_last_compare = p_entry->endtime;
+	return true;
 }
 
 static int Control( demux_t *p_demux, int i_query, va_list args )
 {
-	return p_demux->p_sys->p_subdemux->pf_control(p_demux->p_sys->p_subdemux, i_query, args);
+	demux_t *p_subdemux = p_demux->p_sys->p_subdemux;
+	va_list ap;
+
+	// nothing to check against until the filter file is loaded
+	if (!FilterReady.load(std::memory_order_acquire))
+	{
+		return p_subdemux->pf_control(p_subdemux, i_query, args);
+	}
+	switch (i_query)
+	{
+		case DEMUX_SET_TIME:
+		{
+			va_copy(ap, args);
+			mtime_t i_time = va_arg(ap, int64_t);
+			bool b_precise = (bool)va_arg(ap, int);
+			va_end(ap);
+			if (SeekPastSkip(p_demux, &i_time))
+			{
+				return demux_Control(p_subdemux, DEMUX_SET_TIME, i_time, b_precise);
+			}
+			break;
+		}
+		case DEMUX_SET_POSITION:
+		{
+			va_copy(ap, args);
+			double f_pos = va_arg(ap, double);
+			bool b_precise = (bool)va_arg(ap, int);
+			va_end(ap);
+			mtime_t i_time = (mtime_t)(f_pos * p_demux->p_sys->i_length);
+			int i_title = 0;
+			uint32_t i_sector;
+			if ((p_demux->p_sys->i_length > 0) && SeekPastSkip(p_demux, &i_time))
+			{
+				// position is by sector, so go straight to the VOBU if the title is indexed
+				if ((demux_Control(p_subdemux, DEMUX_GET_TITLE, &i_title) != VLC_SUCCESS) || (i_title != TitleIndex.i_title) ||
+					!IfoTimeToPosition(&TitleIndex, i_time, &f_pos, &i_sector))
+				{
+					f_pos = (double)i_time / (double)p_demux->p_sys->i_length;
+				}
+				return demux_Control(p_subdemux, DEMUX_SET_POSITION, f_pos, b_precise);
+			}
+			break;
+		}
+		case DEMUX_SET_TITLE:
+		{
+			va_copy(ap, args);
+			int i_title = va_arg(ap, int);
+			va_end(ap);
+			if (!FilterNavArray.empty() && NavTitleSkipped(i_title))
+			{
+				msg_Info(p_demux, "Title %d is skipped, going to title %d\n", i_title, NavTitleTarget(i_title));
+				return demux_Control(p_subdemux, DEMUX_SET_TITLE, NavTitleTarget(i_title));
+			}
+			break;
+		}
+		case DEMUX_SET_SEEKPOINT:
+		{
+			va_copy(ap, args);
+			int i_seekpoint = va_arg(ap, int);
+			va_end(ap);
+			int i_title = p_subdemux->info.i_title;
+			int i_seekpoints = (i_title == p_demux->p_sys->i_nav_title) ? p_demux->p_sys->i_nav_seekpoints : NavSeekpointCount(p_subdemux, i_title);
+			int i_next = FilterNavArray.empty() ? i_seekpoint : NavNextSeekpoint(i_title, i_seekpoint, i_seekpoints);
+			if (i_next < 0)
+			{
+				msg_Info(p_demux, "Chapter %d to the end of title %d is skipped, going to title %d\n", i_seekpoint + 1, i_title, NavTitleTarget(i_title));
+				return demux_Control(p_subdemux, DEMUX_SET_TITLE, NavTitleTarget(i_title));
+			}
+			if (i_next != i_seekpoint)
+			{
+				msg_Info(p_demux, "Chapter %d is skipped, going to chapter %d\n", i_seekpoint + 1, i_next + 1);
+				return demux_Control(p_subdemux, DEMUX_SET_SEEKPOINT, i_next);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+	return p_subdemux->pf_control(p_subdemux, i_query, args);
 }
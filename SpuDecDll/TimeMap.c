@@ -0,0 +1,188 @@
+/*****************************************************************************
+ * TimeMap.c : mapping between dvd title time and stream pts
+ *****************************************************************************
+ * Both times run at the same rate, so the mapping is piecewise linear with
+ * a slope of 1; only the offset between them (pts - dvd time) changes, at
+ * discontinuities such as cell changes where pts resets.  Each piece is a
+ * segment of dvd time with its own offset.
+ *
+ * Samples are noisy: dvd time only updates once per VOBU, and the pts is of
+ * whichever block was sent last.  Both make the measured offset too big,
+ * never too small, so the offset follows the lower envelope of the samples.
+ *
+ * A discontinuity is only believed once a second sample agrees with it, so
+ * a single sample straddling a seek (new dvd time, old pts) doesn't start a
+ * bogus piece.
+ *
+ * Lookups check the segment used last first, so they are O(1) while playing
+ * through a segment.
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "spudec.h"
+#include "TimeMap.h"
+
+// offset changes bigger than this are a discontinuity rather than noise
+#define TIMEMAP_JITTER 1000000
+// how quickly the offset may creep back up, as a fraction of the difference (1/n)
+#define TIMEMAP_RISE 256
+
+typedef struct
+{
+	mtime_t i_dvd_start;
+	mtime_t i_dvd_end;      // last dvd time seen in this segment
+	mtime_t i_offset;       // pts - dvd time
+} timemap_segment_t;
+
+static vlc_mutex_t TimeMapLock = VLC_STATIC_MUTEX;
+static std::vector<timemap_segment_t> TimeMapSegmentArray;  // sorted by dvd start, not overlapping
+static size_t TimeMapCurrent;
+static bool TimeMapHavePending;
+static timemap_segment_t TimeMapPending;  // possible discontinuity, waiting for a 2nd sample
+
+static bool sortBySegmentStart(const timemap_segment_t &lhs, const timemap_segment_t &rhs) { return lhs.i_dvd_start < rhs.i_dvd_start; }
+
+// segment for dvd time, segments extend forward until the next one starts; must hold lock & have segments
+static size_t FindDvdSegment(mtime_t i_dvd_time)
+{
+	const size_t count = TimeMapSegmentArray.size();
+	size_t i = TimeMapCurrent;
+
+	// usually the current one, or the one after it
+	if ((i_dvd_time >= TimeMapSegmentArray[i].i_dvd_start) && ((i + 1 == count) || (i_dvd_time < TimeMapSegmentArray[i + 1].i_dvd_start)))
+		return i;
+	if ((i + 1 < count) && (i_dvd_time >= TimeMapSegmentArray[i + 1].i_dvd_start) && ((i + 2 == count) || (i_dvd_time < TimeMapSegmentArray[i + 2].i_dvd_start)))
+		return i + 1;
+
+	timemap_segment_t key = { i_dvd_time, i_dvd_time, 0 };
+	i = std::upper_bound(TimeMapSegmentArray.begin(), TimeMapSegmentArray.end(), key, sortBySegmentStart) - TimeMapSegmentArray.begin();
+	return (i > 0) ? i - 1 : 0;
+}
+
+void TimeMapReset(void)
+{
+	vlc_mutex_lock(&TimeMapLock);
+	TimeMapSegmentArray.clear();
+	TimeMapCurrent = 0;
+	TimeMapHavePending = false;
+	vlc_mutex_unlock(&TimeMapLock);
+}
+
+void TimeMapLearn(mtime_t i_dvd_time, mtime_t i_pts)
+{
+	mtime_t i_offset = i_pts - i_dvd_time;
+	timemap_segment_t *p_seg;
+	size_t i;
+
+	vlc_mutex_lock(&TimeMapLock);
+	if (!TimeMapSegmentArray.empty())
+	{
+		i = FindDvdSegment(i_dvd_time);
+		p_seg = &TimeMapSegmentArray[i];
+		if ((i_dvd_time >= p_seg->i_dvd_start) && (llabs(i_offset - p_seg->i_offset) <= TIMEMAP_JITTER))
+		{
+			// same piece, refine the offset
+			if (i_offset < p_seg->i_offset)
+				p_seg->i_offset = i_offset;
+			else
+				p_seg->i_offset += (i_offset - p_seg->i_offset) / TIMEMAP_RISE;
+			p_seg->i_dvd_end = __MAX(p_seg->i_dvd_end, i_dvd_time);
+			TimeMapCurrent = i;
+			TimeMapHavePending = false;
+			vlc_mutex_unlock(&TimeMapLock);
+			return;
+		}
+	}
+
+	// discontinuity (or first sample), wait for confirmation
+	if (!TimeMapHavePending || (llabs(i_offset - TimeMapPending.i_offset) > TIMEMAP_JITTER) || (i_dvd_time < TimeMapPending.i_dvd_start))
+	{
+		TimeMapPending = { i_dvd_time, i_dvd_time, i_offset };
+		TimeMapHavePending = true;
+		vlc_mutex_unlock(&TimeMapLock);
+		return;
+	}
+	TimeMapHavePending = false;
+
+	// new piece starting at first sample; whatever was learned for later times is cut back to here
+	timemap_segment_t seg = { TimeMapPending.i_dvd_start, i_dvd_time, __MIN(TimeMapPending.i_offset, i_offset) };
+	i_dvd_time = seg.i_dvd_start;
+	auto it = std::upper_bound(TimeMapSegmentArray.begin(), TimeMapSegmentArray.end(), seg, sortBySegmentStart);
+	if ((it != TimeMapSegmentArray.begin()) && ((it - 1)->i_dvd_start == i_dvd_time))
+	{
+		*(it - 1) = seg;
+		TimeMapCurrent = it - 1 - TimeMapSegmentArray.begin();
+	}
+	else
+	{
+		it = TimeMapSegmentArray.insert(it, seg);
+		TimeMapCurrent = it - TimeMapSegmentArray.begin();
+	}
+	if (TimeMapCurrent > 0)
+	{
+		p_seg = &TimeMapSegmentArray[TimeMapCurrent - 1];
+		p_seg->i_dvd_end = __MIN(p_seg->i_dvd_end, i_dvd_time);
+	}
+	vlc_mutex_unlock(&TimeMapLock);
+}
+
+bool TimeMapDvdToPts(mtime_t i_dvd_time, mtime_t *pi_pts)
+{
+	vlc_mutex_lock(&TimeMapLock);
+	if (TimeMapSegmentArray.empty())
+	{
+		vlc_mutex_unlock(&TimeMapLock);
+		return false;
+	}
+	*pi_pts = i_dvd_time + TimeMapSegmentArray[FindDvdSegment(i_dvd_time)].i_offset;
+	vlc_mutex_unlock(&TimeMapLock);
+	return true;
+}
+
+bool TimeMapPtsToDvd(mtime_t i_pts, mtime_t *pi_dvd_time)
+{
+	const timemap_segment_t *p_seg;
+	size_t count;
+	size_t i;
+
+	vlc_mutex_lock(&TimeMapLock);
+	count = TimeMapSegmentArray.size();
+	if (count == 0)
+	{
+		vlc_mutex_unlock(&TimeMapLock);
+		return false;
+	}
+
+	// pts can repeat after a reset, so prefer the current piece, then the ones after it (playback goes forward)
+	for (size_t n = 0; n < count; n++)
+	{
+		i = (TimeMapCurrent + n) % count;
+		p_seg = &TimeMapSegmentArray[i];
+		// current piece extends into the future, others only cover what was seen
+		if ((i_pts >= p_seg->i_dvd_start + p_seg->i_offset) &&
+			((i == TimeMapCurrent) || (i_pts <= p_seg->i_dvd_end + p_seg->i_offset)))
+		{
+			*pi_dvd_time = i_pts - p_seg->i_offset;
+			vlc_mutex_unlock(&TimeMapLock);
+			return true;
+		}
+	}
+	// before anything seen, best guess is the current piece
+	*pi_dvd_time = i_pts - TimeMapSegmentArray[TimeMapCurrent].i_offset;
+	vlc_mutex_unlock(&TimeMapLock);
+	return true;
+}
+
+unsigned int TimeMapSegments(void)
+{
+	unsigned int i_count;
+
+	vlc_mutex_lock(&TimeMapLock);
+	i_count = (unsigned int)TimeMapSegmentArray.size();
+	vlc_mutex_unlock(&TimeMapLock);
+	return i_count;
+}
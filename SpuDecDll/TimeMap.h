@@ -0,0 +1,25 @@
+/*****************************************************************************
+ * TimeMap.h : mapping between dvd title time and stream pts
+ *****************************************************************************/
+
+#ifndef TIMEMAP_H
+#define TIMEMAP_H
+
+// dvd title time is what DEMUX_GET_TIME returns (and DVD_Timescale filter files use),
+// pts is the timestamp on the blocks, which the decoders see (and can reset at cell changes)
+// shared by all modules in the dll, learned by the demux; safe to call from any thread
+
+// forget everything, eg. when the title changes
+void TimeMapReset(void);
+
+// add a sample of the two times, taken at the same point in the stream
+void TimeMapLearn(mtime_t i_dvd_time, mtime_t i_pts);
+
+// false if nothing learned yet
+bool TimeMapDvdToPts(mtime_t i_dvd_time, mtime_t *pi_pts);
+bool TimeMapPtsToDvd(mtime_t i_pts, mtime_t *pi_dvd_time);
+
+// number of linear pieces, for logging
+unsigned int TimeMapSegments(void);
+
+#endif
@@ -50,6 +50,8 @@ static int  ParseRLE(decoder_t *, subpicture_data_t *,
 	const spu_properties_t *);
 static void Render(decoder_t *, subpicture_t *, subpicture_data_t *,
 	const spu_properties_t *);
+static void RenderMask(subpicture_data_t *, const spu_properties_t *,
+	uint8_t *p_mask);
 
 /*****************************************************************************
 * AddNibble: read a nibble from a source packet and add it to our integer.
@@ -67,43 +69,177 @@ static inline unsigned int AddNibble(unsigned int i_code,
 	}
 }
 
+/*****************************************************************************
+* RLE code lengths, in nibbles, indexed by the first byte of the code
+*****************************************************************************
+* 1 nibble codes are >= 0x4, 2 nibbles >= 0x10, 3 nibbles >= 0x40, and
+* anything starting with 0x00 to 0x03 is a 4 nibble code (or end of line).
+*****************************************************************************/
+#define RLE_LEN4(n) n, n, n, n
+#define RLE_LEN16(n) RLE_LEN4(n), RLE_LEN4(n), RLE_LEN4(n), RLE_LEN4(n)
+static const uint8_t pi_rle_nibbles[256] =
+{
+	RLE_LEN4(4), RLE_LEN4(3), RLE_LEN4(3), RLE_LEN4(3),
+	RLE_LEN16(2), RLE_LEN16(2), RLE_LEN16(2),
+	RLE_LEN16(1), RLE_LEN16(1), RLE_LEN16(1), RLE_LEN16(1),
+	RLE_LEN16(1), RLE_LEN16(1), RLE_LEN16(1), RLE_LEN16(1),
+	RLE_LEN16(1), RLE_LEN16(1), RLE_LEN16(1), RLE_LEN16(1),
+};
+#undef RLE_LEN16
+#undef RLE_LEN4
 
 /*****************************************************************************
-* ParsePacket: parse an SPU packet and send it to the video output
+* GetRLECode: read a whole RLE code with a single table lookup
 *****************************************************************************
-* This function parses the SPU packet and, if valid, sends it to the
-* video output.
+* Peeks the next 16 bits at the nibble index, looks up how many nibbles the
+* code uses and returns it, returns 0 if the code would read past i_size.
+* The peek may read up to 2 bytes past the end of the data, the packet
+* buffer is padded for that (SPU_RLE_PEEK_PADDING).
+*****************************************************************************/
+static inline unsigned int GetRLECode(const uint8_t *p_src, unsigned int *pi_index,
+	unsigned int i_size, unsigned int *pi_code)
+{
+	const uint8_t *p = &p_src[*pi_index >> 1];
+	unsigned int i_peek, i_nibbles;
+
+	if ((*pi_index >> 1) >= i_size)
+		return 0;
+
+	if (*pi_index & 0x1)
+		i_peek = ((p[0] << 16 | p[1] << 8 | p[2]) >> 4) & 0xffff;
+	else
+		i_peek = p[0] << 8 | p[1];
+
+	i_nibbles = pi_rle_nibbles[i_peek >> 8];
+	if (((*pi_index + i_nibbles - 1) >> 1) >= i_size)
+		return 0;
+
+	*pi_index += i_nibbles;
+	*pi_code = i_peek >> (16 - 4 * i_nibbles);
+	return i_nibbles;
+}
+
+/*****************************************************************************
+* HashMix: FNV-1a step over the 4 bytes of i_value
 *****************************************************************************/
-// helper function for string comparison
-void toLower(basic_string<wchar_t>& s) {
-	for (basic_string<wchar_t>::iterator p = s.begin();
-		p != s.end(); ++p) {
-		*p = towlower(*p);
+#define SPU_HASH_INIT UINT64_C(0xcbf29ce484222325)
+static inline uint64_t HashMix(uint64_t i_hash, uint32_t i_value)
+{
+	for (int i = 0; i < 4; i++, i_value >>= 8)
+	{
+		i_hash ^= i_value & 0xff;
+		i_hash *= UINT64_C(0x100000001b3);
 	}
+	return i_hash;
 }
 
-subpicture_t * ParsePacket(decoder_t *p_dec, std::wstring *subtitle_text)
+#ifdef DEBUG_SPUDEC
+/* Original nibble at a time reader, used to cross check GetRLECode */
+static unsigned int GetRLECodeNibbles(const uint8_t *p_src, unsigned int *pi_index,
+	unsigned int i_size, unsigned int *pi_code)
+{
+	unsigned int i_code = 0;
+	unsigned int i_start = *pi_index;
+	for (unsigned int i_min = 1; i_min <= 0x40 && i_code < i_min; i_min <<= 2)
+	{
+		if ((*pi_index >> 1) >= i_size)
+			return 0;
+		i_code = AddNibble(i_code, p_src, pi_index);
+	}
+	*pi_code = i_code;
+	return *pi_index - i_start;
+}
+#endif
+
+
+/*****************************************************************************
+* GetScratch: get a decoder owned buffer of at least i_size bytes
+*****************************************************************************
+* The buffers only ever grow, so once the biggest subtitle of the movie has
+* been seen there are no more allocations for the rle codes or the ocr mask.
+*****************************************************************************/
+static void *GetScratch(decoder_sys_t *p_sys, spu_scratch_t *p_scratch, size_t i_size)
+{
+	if (i_size > p_scratch->i_size)
+	{
+		size_t i_new_size = __MAX(i_size, 2 * p_scratch->i_size);
+		i_new_size = (i_new_size + 4095) & ~(size_t)4095;
+
+		free(p_scratch->p_buffer);
+		p_scratch->p_buffer = (uint8_t *)malloc(i_new_size);
+		p_scratch->i_size = p_scratch->p_buffer ? i_new_size : 0;
+		p_sys->i_scratch_allocs++;
+	}
+	return p_scratch->p_buffer;
+}
+
+void ReleaseScratch(decoder_sys_t *p_sys)
+{
+	free(p_sys->rle_scratch.p_buffer);
+	p_sys->rle_scratch.p_buffer = NULL;
+	p_sys->rle_scratch.i_size = 0;
+	free(p_sys->mask_scratch.p_buffer);
+	p_sys->mask_scratch.p_buffer = NULL;
+	p_sys->mask_scratch.i_size = 0;
+	OcrBitmapPoolDelete(p_sys->p_ocr_pool);
+	p_sys->p_ocr_pool = NULL;
+}
+
+/*****************************************************************************
+* ParsePacket: parse an SPU packet and send it to the video output
+*****************************************************************************
+* This function parses the SPU packet and, if valid, sends it to the
+* video output.
+* The subtitle text is read from a mask expanded straight from the RLE codes,
+* the yuvp region is only rendered when dvdsub-render-enable is set; in that
+* case *pp_spu gets the subpicture to queue, else it is left NULL and nothing
+* is allocated here.
+*****************************************************************************/
+int ParsePacket(decoder_t *p_dec, std::wstring *subtitle_text,
+	mtime_t *pi_start, mtime_t *pi_stop, subpicture_t **pp_spu)
 {
 	decoder_sys_t *p_sys = p_dec->p_sys;
 	subpicture_t *p_spu;
+	subpicture_t spu_timing;
 	subpicture_data_t spu_data;
 	spu_properties_t spu_properties;
 
-	/* Allocate the subpicture internal data. */
-	p_spu = decoder_NewSubpicture(p_dec, NULL);
-	if (!p_spu) return NULL;
-
-	p_spu->i_original_picture_width =
-		p_dec->fmt_in.subs.spu.i_original_frame_width;
-	p_spu->i_original_picture_height =
-		p_dec->fmt_in.subs.spu.i_original_frame_height;
+	*pp_spu = NULL;
+	if (p_sys->b_RenderEnable)
+	{
+		/* Allocate the subpicture internal data. */
+		p_spu = decoder_NewSubpicture(p_dec, NULL);
+		if (!p_spu) return VLC_EGENERIC;
+
+		p_spu->i_original_picture_width =
+			p_dec->fmt_in.subs.spu.i_original_frame_width;
+		p_spu->i_original_picture_height =
+			p_dec->fmt_in.subs.spu.i_original_frame_height;
+	}
+	else
+	{
+		/* only need the dates, ParseControlSeq doesn't touch anything else */
+		memset(&spu_timing, 0, sizeof(spu_timing));
+		p_spu = &spu_timing;
+	}
 
 	/* Getting the control part */
 	if (ParseControlSeq(p_dec, p_spu, &spu_data, &spu_properties, p_sys->i_pts))
 	{
 		/* There was a parse error, delete the subpicture */
-		subpicture_Delete(p_spu);
-		return NULL;
+		if (p_spu != &spu_timing)
+			subpicture_Delete(p_spu);
+		return VLC_EGENERIC;
+	}
+
+	/* ocr can read the text from just one field, so when nothing gets
+	* rendered only decode the even field, at half height, and tell the ocr
+	* stage to stretch it back */
+	spu_data.i_y_scale = 1;
+	if (p_sys->b_SingleFieldEnable && !p_sys->b_RenderEnable)
+	{
+		spu_data.i_y_scale = 2;
+		spu_properties.i_height = (spu_properties.i_height + 1) / 2;
 	}
 
 	/* we are going to expand the RLE stuff so that we won't need to read
@@ -114,18 +250,24 @@ subpicture_t * ParsePacket(decoder_t *p_dec, std::wstring *subtitle_text)
 	*  one byte gaves two nibbles and may be used twice (once per field)
 	* generating 4 codes.
 	*/
-	spu_data.p_data = (uint16_t *)vlc_alloc(p_sys->i_rle_size, sizeof(*spu_data.p_data) * 2 * 2);
+	spu_data.p_data = (uint16_t *)GetScratch(p_sys, &p_sys->rle_scratch,
+		(size_t)p_sys->i_rle_size * sizeof(*spu_data.p_data) * 2 * 2);
 
 	/* We try to display it */
-	if (ParseRLE(p_dec, &spu_data, &spu_properties))
+#ifdef DEBUG_SPUDEC
+	mtime_t i_rle_start = mdate();
+#endif
+	if (spu_data.p_data == NULL || ParseRLE(p_dec, &spu_data, &spu_properties))
 	{
 		/* There was a parse error, delete the subpicture */
-		subpicture_Delete(p_spu);
-		free(spu_data.p_data);
-		return NULL;
+		if (p_spu != &spu_timing)
+			subpicture_Delete(p_spu);
+		return VLC_EGENERIC;
 	}
 
 #ifdef DEBUG_SPUDEC
+	msg_Dbg(p_dec, "ParseRLE took %lld us for %ix%i", mdate() - i_rle_start,
+		spu_properties.i_width, spu_properties.i_height);
 	msg_Dbg(p_dec, "total size: 0x%x, RLE offsets: 0x%x 0x%x",
 		p_sys->i_spu_size,
 		spu_data.pi_offset[0], spu_data.pi_offset[1]);
@@ -136,20 +278,55 @@ subpicture_t * ParsePacket(decoder_t *p_dec, std::wstring *subtitle_text)
 	//   This situation can occur either because OCR failed to detect any text or when it detects text incorrectly
 	//   In the meantime, can put "No Text Detected" in the filter word file to handle case where it fails to detect any text
 	//   seems decoder has particular issues with words 4 letters or less, i've seen problems on multiple dvds
-	*subtitle_text = OcrDecodeText(&spu_data, &spu_properties, p_sys);
-	toLower(*subtitle_text);
+	if (p_sys->b_last_text_valid && spu_data.i_content_hash == p_sys->i_last_content_hash)
+	{
+		// same picture as last subtitle (eg. split in two because of a cell change), no need to ocr again
+		subtitle_text->assign(p_sys->psz_last_text);
+	}
+	else
+	{
+		const int i_mask_width = spu_properties.i_width - spu_data.i_crop_left - spu_data.i_crop_right;
+		const int i_mask_height = spu_properties.i_height - spu_data.i_crop_top - spu_data.i_crop_bottom;
+		uint8_t *p_mask = NULL;
+
+		if (i_mask_width > 0 && i_mask_height > 0)
+		{
+			p_mask = (uint8_t *)GetScratch(p_sys, &p_sys->mask_scratch,
+				(size_t)i_mask_width * i_mask_height);
+			if (p_mask == NULL)
+			{
+				if (p_spu != &spu_timing)
+					subpicture_Delete(p_spu);
+				return VLC_EGENERIC;
+			}
+			RenderMask(&spu_data, &spu_properties, p_mask);
+		}
+		if (p_sys->p_ocr_pool == NULL)
+		{
+			p_sys->p_ocr_pool = OcrBitmapPoolNew();  // NULL just means no reuse
+		}
+		subtitle_text->assign(OcrDecodeMask(p_sys->p_ocr_pool, p_mask, __MAX(i_mask_width, 0), __MAX(i_mask_height, 0), spu_data.i_y_scale, spu_data.i_text_color, p_sys->b_CaptureTextPicsEnable));
+
+		p_sys->b_last_text_valid = subtitle_text->size() < ARRAYSIZE(p_sys->psz_last_text);
+		if (p_sys->b_last_text_valid)
+		{
+			wcscpy_s(p_sys->psz_last_text, ARRAYSIZE(p_sys->psz_last_text), subtitle_text->c_str());
+			p_sys->i_last_content_hash = spu_data.i_content_hash;
+		}
+	}
 
 	// only render if enabled
 	if (p_sys->b_RenderEnable)
 	{
 		Render(p_dec, p_spu, &spu_data, &spu_properties);
+		*pp_spu = p_spu;
 	}
 
-	free(spu_data.p_data);
-
+	*pi_start = p_spu->i_start;
+	*pi_stop = p_spu->i_stop;
+	p_sys->i_subtitles++;
 
-
-	return p_spu;
+	return VLC_SUCCESS;
 }
 
 /*****************************************************************************
@@ -189,6 +366,11 @@ static int ParseControlSeq(decoder_t *p_dec, subpicture_t *p_spu,
 	spu_data_cmd.b_auto_crop = false;
 	spu_data_cmd.i_y_top_offset = 0;
 	spu_data_cmd.i_y_bottom_offset = 0;
+	spu_data_cmd.i_text_color = -1;
+	spu_data_cmd.i_crop_left = spu_data_cmd.i_crop_right = 0;
+	spu_data_cmd.i_crop_top = spu_data_cmd.i_crop_bottom = 0;
+	spu_data_cmd.i_content_hash = 0;
+	spu_data_cmd.i_y_scale = 1;
 	spu_data_cmd.pi_alpha[0] = 0x00;
 	spu_data_cmd.pi_alpha[1] = 0x0f;
 	spu_data_cmd.pi_alpha[2] = 0x0f;
@@ -480,6 +662,14 @@ static int ParseRLE(decoder_t *p_dec,
 	int i_border = -1;
 	int stats[4]; stats[0] = stats[1] = stats[2] = stats[3] = 0;
 
+	/* Opaque bounding box and content hash, straight from the runs
+	 * transparent runs all hash the same whatever their color index, and
+	 * neighbouring runs of the same color are merged first, so the hash
+	 * only depends on what the subtitle looks like, not how it was coded */
+	unsigned int i_left = i_width, i_right = 0, i_top = i_height, i_bottom = 0;
+	uint64_t i_hash = HashMix(HashMix(SPU_HASH_INIT, i_width), i_height);
+	unsigned int i_run_color, i_run_len;
+
 	pi_table[0] = p_spu_data->pi_offset[0] << 1;
 	pi_table[1] = p_spu_data->pi_offset[1] << 1;
 
@@ -487,19 +677,29 @@ static int ParseRLE(decoder_t *p_dec,
 	{
 		unsigned int i_code;
 		pi_offset = pi_table + i_id;
+		i_run_color = 4;
+		i_run_len = 0;
 
 		for (i_x = 0; i_x < i_width; i_x += i_code >> 2)
 		{
-			i_code = 0;
-			for (unsigned int i_min = 1; i_min <= 0x40 && i_code < i_min; i_min <<= 2)
+#ifdef DEBUG_SPUDEC
+			const unsigned int i_start_offset = *pi_offset;
+			unsigned int i_check_offset = *pi_offset, i_check_code = 0;
+			unsigned int i_check_len = GetRLECodeNibbles(&p_sys->buffer[4], &i_check_offset, p_sys->i_spu_size, &i_check_code);
+#endif
+			if (!GetRLECode(&p_sys->buffer[4], pi_offset, p_sys->i_spu_size, &i_code))
 			{
-				if ((*pi_offset >> 1) >= p_sys->i_spu_size)
-				{
-					msg_Err(p_dec, "out of bounds while reading rle");
-					return VLC_EGENERIC;
-				}
-				i_code = AddNibble(i_code, &p_sys->buffer[4], pi_offset);
+				msg_Err(p_dec, "out of bounds while reading rle");
+				return VLC_EGENERIC;
+			}
+#ifdef DEBUG_SPUDEC
+			if (i_check_len == 0 || i_check_offset != *pi_offset || i_check_code != i_code)
+			{
+				// code & offset after it, table reader vs nibble reader
+				msg_Err(p_dec, "rle table decode mismatch at nibble %u: 0x%x/%u != 0x%x/%u",
+					i_start_offset, i_code, *pi_offset, i_check_code, i_check_offset);
 			}
+#endif
 			if (i_code < 0x0004)
 			{
 				/* If the 14 first bits are set to 0, then it's a
@@ -519,7 +719,29 @@ static int ParseRLE(decoder_t *p_dec,
 			{
 				i_border = i_code & 0x3;
 				stats[i_border] += i_code >> 2;
+
+				if (i_x < i_left)
+					i_left = i_x;
+				if (i_x + (i_code >> 2) > i_right)
+					i_right = i_x + (i_code >> 2);
+				if (i_y < i_top)
+					i_top = i_y;
+				i_bottom = i_y + 1;
+
+				if ((i_code & 0x3) != i_run_color)
+				{
+					i_hash = HashMix(i_hash, i_run_color << 16 | i_run_len);
+					i_run_color = i_code & 0x3;
+					i_run_len = 0;
+				}
 			}
+			else if (i_run_color != 4)
+			{
+				i_hash = HashMix(i_hash, i_run_color << 16 | i_run_len);
+				i_run_color = 4;
+				i_run_len = 0;
+			}
+			i_run_len += i_code >> 2;
 
 			/* Auto crop subtitles (a lot more optimized) */
 			if (p_spu_data->b_auto_crop)
@@ -571,6 +793,9 @@ static int ParseRLE(decoder_t *p_dec,
 			}
 		}
 
+		/* end of line for the hash */
+		i_hash = HashMix(HashMix(i_hash, i_run_color << 16 | i_run_len), 0xffffffff);
+
 		/* Check that we didn't go too far */
 		if (i_x > i_width)
 		{
@@ -584,8 +809,9 @@ static int ParseRLE(decoder_t *p_dec,
 			(*pi_offset)++;
 		}
 
-		/* Swap fields */
-		i_id = ~i_id & 0x1;
+		/* Swap fields, unless only decoding the even one */
+		if (p_spu_data->i_y_scale == 1)
+			i_id = ~i_id & 0x1;
 	}
 
 	/* We shouldn't get any padding bytes */
@@ -625,43 +851,69 @@ static int ParseRLE(decoder_t *p_dec,
 #endif
 	}
 
-	/* Handle color if no palette was found */
-	if (!p_spu_data->b_palette)
+	/* Opaque area, as crop values from each edge */
+	if (i_right > i_left)
+	{
+		p_spu_data->i_crop_left = i_left;
+		p_spu_data->i_crop_right = i_width - i_right;
+		p_spu_data->i_crop_top = i_top;
+		p_spu_data->i_crop_bottom = i_height - i_bottom;
+	}
+	else
 	{
-		int i, i_inner = -1, i_shade = -1;
+		/* nothing visible */
+		p_spu_data->i_crop_left = i_width;
+		p_spu_data->i_crop_right = 0;
+		p_spu_data->i_crop_top = i_height;
+		p_spu_data->i_crop_bottom = 0;
+	}
+	p_spu_data->i_content_hash = i_hash;
 
-		/* Set the border color */
-		if (i_border != -1)
+	/* Find the border, inner and anti-aliasing colors
+	 * this is needed for the custom palette, but the inner color is also our
+	 * best guess of the text color for ocr, so always do it */
+	int i, i_inner = -1, i_shade = -1;
+
+	if (i_border != -1)
+	{
+		stats[i_border] = 0;
+	}
+
+	for (i = 0; i < 4 && i_inner == -1; i++)
+	{
+		if (stats[i])
 		{
-			p_spu_data->pi_yuv[i_border][0] = 0x00;
-			p_spu_data->pi_yuv[i_border][1] = 0x80;
-			p_spu_data->pi_yuv[i_border][2] = 0x80;
-			stats[i_border] = 0;
+			i_inner = i;
 		}
+	}
 
-		/* Find the inner colors */
-		for (i = 0; i < 4 && i_inner == -1; i++)
+	for (; i < 4 && i_shade == -1; i++)
+	{
+		if (stats[i])
 		{
-			if (stats[i])
+			if (stats[i] > stats[i_inner])
 			{
+				i_shade = i_inner;
 				i_inner = i;
 			}
+			else
+			{
+				i_shade = i;
+			}
 		}
+	}
 
-		for (; i < 4 && i_shade == -1; i++)
+	p_spu_data->i_text_color = (i_inner != -1) ? i_inner : i_border;
+
+	/* Handle color if no palette was found */
+	if (!p_spu_data->b_palette)
+	{
+		/* Set the border color */
+		if (i_border != -1)
 		{
-			if (stats[i])
-			{
-				if (stats[i] > stats[i_inner])
-				{
-					i_shade = i_inner;
-					i_inner = i;
-				}
-				else
-				{
-					i_shade = i;
-				}
-			}
+			p_spu_data->pi_yuv[i_border][0] = 0x00;
+			p_spu_data->pi_yuv[i_border][1] = 0x80;
+			p_spu_data->pi_yuv[i_border][2] = 0x80;
 		}
 
 		/* Set the inner color */
@@ -748,3 +1000,51 @@ static void Render(decoder_t *p_dec, subpicture_t *p_spu,
 	video_format_Clean(&fmt);
 }
 
+/*****************************************************************************
+* RenderMask: expand the RLE codes into the ocr mask
+*****************************************************************************
+* Same walk as Render, but into a tightly packed 1 byte per pixel mask, with
+* the transparency already resolved, so the ocr stage doesn't need a region,
+* a palette or a second full frame conversion.
+* Only the opaque area found by ParseRLE is written, so the mask is
+* (i_width - crop left/right) x (i_height - crop top/bottom).
+*****************************************************************************/
+static void RenderMask(subpicture_data_t *p_spu_data,
+	const spu_properties_t *p_spu_properties, uint8_t *p_mask)
+{
+	const uint16_t *p_source = p_spu_data->p_data;
+	const int i_width = p_spu_properties->i_width;
+	const int i_left = p_spu_data->i_crop_left;
+	const int i_right = i_width - p_spu_data->i_crop_right;
+	const int i_mask_width = i_right - i_left;
+	const int i_mask_height = p_spu_properties->i_height -
+		p_spu_data->i_crop_top - p_spu_data->i_crop_bottom;
+	uint8_t pi_bits[4];
+	int i_x, i_y, i_len, i_color;
+
+	for (i_color = 0; i_color < 4; i_color++)
+	{
+		pi_bits[i_color] = p_spu_data->pi_alpha[i_color] ? SPU_OCR_MASK_BIT(i_color) : 0;
+	}
+
+	/* Skip the transparent lines above the opaque area that weren't already
+	 * dropped by the auto crop */
+	for (i_y = p_spu_data->i_y_top_offset; i_y < p_spu_data->i_crop_top; i_y++)
+	{
+		for (i_x = 0; i_x < i_width; i_x += *p_source++ >> 2);
+	}
+
+	for (i_y = 0; i_y < i_mask_height; i_y++, p_mask += i_mask_width)
+	{
+		for (i_x = 0; i_x < i_width; i_x += i_len)
+		{
+			i_color = *p_source & 0x3;
+			i_len = *p_source++ >> 2;
+
+			int i_start = __MAX(i_x, i_left);
+			int i_end = __MIN(i_x + i_len, i_right);
+			if (i_end > i_start)
+				memset(p_mask + i_start - i_left, pi_bits[i_color], i_end - i_start);
+		}
+	}
+}
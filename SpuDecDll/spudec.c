@@ -40,20 +40,23 @@
 // tried moving to decoder_sys_t, but i think problems due to dynamic size
 static std::vector<std::wstring> badwords;
 
-struct decoder_sys_t
+// word list is read in the background, started by the demux at open (or the first decoder), so the open path doesn't wait on file i/o
+// badwords is only touched with WordsLock held
+typedef enum
 {
-	decoder_t * p_subdec;
+	WORDS_IDLE,
+	WORDS_LOADING,
+	WORDS_READY,
+} words_state_t;
+static vlc_mutex_t WordsLock = VLC_STATIC_MUTEX;
+static vlc_cond_t WordsCond = VLC_STATIC_COND;
+static words_state_t WordsState = WORDS_IDLE;
+static vlc_thread_t WordsThread;
+static bool WordsThreadJoinable = false;
+static vlc_object_t *WordsObj;   // for messages
 
-	//new
-	bool b_videofilterEnable;
-	bool b_audiofilterEnable;
-	bool b_RenderEnable;
-	bool b_DumpTextToFileEnable;
-	bool b_CaptureTextPicsEnable;
-
-	// i think problems having this in here due to dynamic size
-	//std::vector<std::wstring> badwords;
-};
+// longest a subtitle check waits for the word list
+#define WORDS_WAIT_MAX 2000000
 
 
 static int  Decode(decoder_t *, block_t *);
@@ -68,6 +71,7 @@ extern void EndAudioDec(vlc_object_t *);
 
 // input demux
 extern int  DemuxOpen(vlc_object_t *);
+extern int  DemuxOpenFile(vlc_object_t *);
 extern void DemuxClose(vlc_object_t *);
 
 /*****************************************************************************
@@ -82,13 +86,13 @@ extern void DemuxClose(vlc_object_t *);
 //  *badword_b
 //  badword_c*
 //  *badword_d*
-static void LoadWords(decoder_t *p_dec)
+static void LoadWords(std::vector<std::wstring> &words)
 {
 	// Todo:  change input file format, or somehow obfuscate the contents
 	std::wifstream infile("filter_words.txt");
 	std::wstring line;
 
-	badwords.clear();
+	words.clear();
 
 	while (std::getline(infile, line))
 	{
@@ -110,9 +114,86 @@ static void LoadWords(decoder_t *p_dec)
 				line.pop_back();
 				LastChar = L"";
 			}
-			badwords.push_back(FirstChar + line + LastChar);
+			words.push_back(FirstChar + line + LastChar);
+		}
+	}
+}
+
+static void *WordListThread(void *p_data)
+{
+	std::vector<std::wstring> words;
+	mtime_t start_time = mdate();
+	VLC_UNUSED(p_data);
+
+	LoadWords(words);
+
+	vlc_mutex_lock(&WordsLock);
+	badwords.swap(words);
+	WordsState = WORDS_READY;
+	msg_Info(WordsObj, "Loaded %u words in %lld us (in background)\n", (unsigned int)badwords.size(), mdate() - start_time);
+	vlc_cond_broadcast(&WordsCond);
+	vlc_mutex_unlock(&WordsLock);
+	return NULL;
+}
+
+// join the finished (or finishing) load thread, if there is one. call without WordsLock
+static void WordListJoin(void)
+{
+	bool b_join;
+
+	vlc_mutex_lock(&WordsLock);
+	b_join = WordsThreadJoinable;
+	WordsThreadJoinable = false;
+	vlc_mutex_unlock(&WordsLock);
+	if (b_join)
+	{
+		vlc_join(WordsThread, NULL);
+	}
+}
+
+// start loading the word list in the background; b_reload reads it again even if already loaded (new movie)
+void WordListLoadStart(vlc_object_t *p_obj, bool b_reload)
+{
+	vlc_mutex_lock(&WordsLock);
+	if ((WordsState == WORDS_LOADING) || ((WordsState == WORDS_READY) && !b_reload))
+	{
+		vlc_mutex_unlock(&WordsLock);
+		return;
+	}
+	vlc_mutex_unlock(&WordsLock);
+	// previous load has finished, clean up its thread before starting another
+	WordListJoin();
+
+	// someone else may have started (or finished) a load while we were joining
+	vlc_mutex_lock(&WordsLock);
+	if (!((WordsState == WORDS_LOADING) || ((WordsState == WORDS_READY) && !b_reload)))
+	{
+		// input outlives the demux & decoders, any of which may have started this
+		WordsObj = (p_obj->obj.parent != NULL) ? p_obj->obj.parent : p_obj;
+		WordsState = WORDS_LOADING;
+		if (vlc_clone(&WordsThread, WordListThread, NULL, VLC_THREAD_PRIORITY_LOW) == 0)
+		{
+			WordsThreadJoinable = true;
+		}
+		else
+		{
+			// no thread, do it here
+			msg_Warn(p_obj, "couldn't start word list thread, loading now\n");
+			LoadWords(badwords);
+			WordsState = WORDS_READY;
 		}
 	}
+	vlc_mutex_unlock(&WordsLock);
+}
+
+// done with the word list (demux close): wait for any load & empty it
+void WordListRelease(void)
+{
+	WordListJoin();
+	vlc_mutex_lock(&WordsLock);
+	badwords.clear();
+	WordsState = WORDS_IDLE;
+	vlc_mutex_unlock(&WordsLock);
 }
 
 // This will return true if it matches a badword in sentence
@@ -120,7 +201,19 @@ static bool ParseForWords(decoder_t *p_dec, std::wstring sentence)
 {
 	size_t i;
 	size_t sentenceindx;
-	for (i = 0; i < badwords.size(); i++)
+	bool b_found = false;
+	mtime_t deadline = mdate() + WORDS_WAIT_MAX;
+
+	// normally loaded long before the first subtitle; if not, wait a bit rather than let it through
+	WordListLoadStart(VLC_OBJECT(p_dec), false);
+	vlc_mutex_lock(&WordsLock);
+	while ((WordsState == WORDS_LOADING) && (vlc_cond_timedwait(&WordsCond, &WordsLock, deadline) == 0))
+		;
+	if (WordsState != WORDS_READY)
+	{
+		msg_Warn(p_dec, "word list not loaded yet, subtitle not checked\n");
+	}
+	for (i = 0; (i < badwords.size()) && !b_found; i++)
 	{
 		// replace all non alpha characters, including start & end of line with space
 		// todo: is this OK?  it's replacing all non letters, including ', which will split contractions.
@@ -136,10 +229,11 @@ static bool ParseForWords(decoder_t *p_dec, std::wstring sentence)
 		sentence.push_back(L' ');
 		if (sentence.find(badwords[i]) != string::npos)
 		{
-			return TRUE;
+			b_found = true;
 		}
 	}
-	return FALSE;
+	vlc_mutex_unlock(&WordsLock);
+	return b_found;
 }
 
 
@@ -159,6 +253,24 @@ static bool ParseForWords(decoder_t *p_dec, std::wstring sentence)
 #define DVDSUBAUDIO_RENDER_TEXT N_("Enabling rendering of subtitles")
 #define DVDSUBAUDIO_SUB_TO_FILE_TEXT N_("Save subtitle text to file")
 #define DVDSUBAUDIO_SAVE_SUB_PIC_TEXT N_("Save pic of subtitle")
+#define DVDSUB_NATIVE_DECODE_TEXT N_("Use built-in subtitle decoder")
+#define DVDSUB_NATIVE_DECODE_LONGTEXT N_("Decodes DVD subtitles directly from the RLE data for OCR, instead of letting the vlc spudec module render them first. Subtitles are only rendered if rendering is enabled.")
+#define DVDSUB_EARLY_OCR_TEXT N_("OCR subtitles as they are demuxed")
+#define DVDSUB_EARLY_OCR_LONGTEXT N_("Subtitles are decoded and checked by the demux as soon as they are read from the disc, well before they are displayed, so mutes are known ahead of time. Uses the built-in decoder.")
+#define DVDSUB_SINGLE_FIELD_TEXT N_("Only decode one field of subtitles for OCR")
+#define DVDSUB_SINGLE_FIELD_LONGTEXT N_("With the built-in decoder and rendering disabled, only decode the even lines of the subtitle. About half the work, OCR sees the picture stretched back to full height.")
+#define DVDSUB_FILTER_MERGE_GAP_TEXT N_("Merge filter entries closer than (ms)")
+#define DVDSUB_FILTER_MERGE_GAP_LONGTEXT N_("Skips (or mutes) in the filter file that overlap or are less than this many milliseconds apart are combined into one, so a single seek is done instead of several.")
+#define DVDSUB_FILTER_PRE_PAD_TEXT N_("Start filter entries earlier by (ms)")
+#define DVDSUB_FILTER_POST_PAD_TEXT N_("End filter entries later by (ms)")
+#define DVDSUB_FILTER_PROFILE_TEXT N_("Filter profile")
+#define DVDSUB_FILTER_PROFILE_LONGTEXT N_("Categories of filter entries to use, comma separated, each optionally =mute or =skip to override the file, eg. violence=skip,language=mute,sex. Categories: language, violence, sex, nudity, drugs, gore, scary, crude, other. Empty or all uses every entry; entries without a category are always used.")
+#define DVDSUB_SKIP_DROP_MAX_TEXT N_("Drop skips shorter than (ms)")
+#define DVDSUB_SKIP_DROP_MAX_LONGTEXT N_("Skips shorter than this are done by throwing away the audio and video in them as they are read, with no seek. Playback carries straight on, but the picture may hold for a moment until the next keyframe. 0 always seeks.")
+#define DVDSUB_MUTE_RAMP_TEXT N_("Mute fade (ms)")
+#define DVDSUB_MUTE_RAMP_LONGTEXT N_("Audio fades out over this long at the start of a mute, and back in at the end, instead of cutting (which clicks). 0 cuts.")
+#define DVDSUB_MUTE_BENCHMARK_TEXT N_("Benchmark mute")
+#define DVDSUB_MUTE_BENCHMARK_LONGTEXT N_("When the audio decoder opens, time muting each sample format and log samples per second.")
 
 vlc_module_begin ()
     set_description( N_("Movie filter") )
@@ -178,6 +290,26 @@ vlc_module_begin ()
 		DVDSUBAUDIO_SUB_TO_FILE_TEXT, DVDSUBAUDIO_SUB_TO_FILE_TEXT, true)
 	add_bool("dvdsub-save-text-pic-enable", false,
 		DVDSUBAUDIO_SAVE_SUB_PIC_TEXT, DVDSUBAUDIO_SAVE_SUB_PIC_TEXT, true)
+	add_bool("dvdsub-native-decode", false,
+		DVDSUB_NATIVE_DECODE_TEXT, DVDSUB_NATIVE_DECODE_LONGTEXT, true)
+	add_bool("dvdsub-ocr-single-field", false,
+		DVDSUB_SINGLE_FIELD_TEXT, DVDSUB_SINGLE_FIELD_LONGTEXT, true)
+	add_bool("dvdsub-early-ocr", false,
+		DVDSUB_EARLY_OCR_TEXT, DVDSUB_EARLY_OCR_LONGTEXT, true)
+	add_integer("dvdsub-filter-merge-gap", 250,
+		DVDSUB_FILTER_MERGE_GAP_TEXT, DVDSUB_FILTER_MERGE_GAP_LONGTEXT, true)
+	add_integer("dvdsub-filter-pre-pad", 0,
+		DVDSUB_FILTER_PRE_PAD_TEXT, DVDSUB_FILTER_PRE_PAD_TEXT, true)
+	add_integer("dvdsub-filter-post-pad", 0,
+		DVDSUB_FILTER_POST_PAD_TEXT, DVDSUB_FILTER_POST_PAD_TEXT, true)
+	add_string("dvdsub-filter-profile", "",
+		DVDSUB_FILTER_PROFILE_TEXT, DVDSUB_FILTER_PROFILE_LONGTEXT, false)
+	add_integer("dvdsub-skip-drop-max", 0,
+		DVDSUB_SKIP_DROP_MAX_TEXT, DVDSUB_SKIP_DROP_MAX_LONGTEXT, true)
+	add_integer("dvdsub-mute-ramp", 5,
+		DVDSUB_MUTE_RAMP_TEXT, DVDSUB_MUTE_RAMP_LONGTEXT, true)
+	add_bool("dvdsub-mute-benchmark", false,
+		DVDSUB_MUTE_BENCHMARK_TEXT, DVDSUB_MUTE_BENCHMARK_LONGTEXT, true)
 
 	add_submodule()
 	add_shortcut("MovAudDecFlt")
@@ -189,6 +321,11 @@ vlc_module_begin ()
 	set_capability("access_demux", 80)
 	set_callbacks(DemuxOpen, DemuxClose)
 
+	add_submodule()
+	add_shortcut("MovFiltFile")
+	set_capability("demux", 300)  // ahead of mp4 (240) & the rest, declines files without a filter file
+	set_callbacks(DemuxOpenFile, DemuxClose)
+
 vlc_module_end ()
 
 
@@ -205,6 +342,36 @@ static void toLower(basic_string<wchar_t>& s) {
 	}
 }
 
+// common handling of the ocr'd subtitle text, for both the vlc spudec and native decode paths
+// p_dec is the local (this module) decoder, or the early ocr one; either way its parent is the input
+void ProcessSubtitleText(decoder_t *p_dec, std::wstring &subtitle_text, mtime_t i_start, mtime_t i_stop)
+{
+	decoder_sys_t * p_sys = p_dec->p_sys;
+
+	toLower(subtitle_text);
+	msg_Info(p_dec, "subtitle_text: %s\n", FromWide(subtitle_text.c_str()));
+	if ((ParseForWords(p_dec, subtitle_text) == TRUE) && (p_sys->p_mute != NULL))
+	{
+		// queue the mute
+		MuteSchedulePush(p_sys->p_mute, p_sys->i_mute_source, i_start, i_stop);
+	}
+
+	if (p_sys->b_DumpTextToFileEnable)
+	{
+		ofstream myfile;
+		myfile.open("SubTextOutput.txt", ofstream::out | ofstream::app);
+		char starttime[SRT_BUF_SIZE];
+		char endtime[SRT_BUF_SIZE];
+
+		mtime_to_srttime(starttime, i_start);
+		mtime_to_srttime(endtime, i_stop);
+
+		myfile << 1 << "\n" << starttime << " --> " << endtime << "\n" << FromWide(subtitle_text.c_str()) << "\n\n";
+
+		myfile.close();
+	}
+}
+
 // note: this is called from subdecoder, so the p_dec pointer is the subdec pointer, not local one
 // need to use local pointer for calling original queue audio
 static int MyDecoderQueueSub(decoder_t *p_dec, subpicture_t * p_spu)
@@ -217,6 +384,16 @@ static int MyDecoderQueueSub(decoder_t *p_dec, subpicture_t * p_spu)
 	assert(p_spu->p_next == NULL);
 	assert(my_local_p_dec->pf_queue_sub != NULL);
 
+	// ocr would start about now
+	if (p_sys->b_OcrTiming)
+	{
+		if (p_sys->p_mute != NULL)
+		{
+			MuteScheduleOcrNote(p_sys->p_mute, MUTE_SOURCE_SUBTITLE, p_spu->i_start, mdate(), 0);
+		}
+		return my_local_p_dec->pf_queue_sub(p_dec, p_spu);
+	}
+
 	// can access pic here
 	picture_t * sub_pic;
 	subpicture_region_t * sub_region;
@@ -234,31 +411,10 @@ static int MyDecoderQueueSub(decoder_t *p_dec, subpicture_t * p_spu)
 	else
 	{
 		subtitle_text.assign(OcrDecodeText(sub_region, p_sys->b_CaptureTextPicsEnable));
-		toLower(subtitle_text);
-	}
-
-	msg_Info(p_dec, "subtitle_text: %s\n", FromWide(subtitle_text.c_str()));
-	if (ParseForWords(my_local_p_dec, subtitle_text) == TRUE)
-	{
-		// queue the mute
-		var_SetInteger(my_local_p_dec->obj.parent, "mute_start_time", p_spu->i_start);
-		var_SetInteger(my_local_p_dec->obj.parent, "mute_end_time", p_spu->i_stop);
 	}
 
-	if (p_sys->b_DumpTextToFileEnable)
-	{
-		ofstream myfile;
-		myfile.open("SubTextOutput.txt", ofstream::out | ofstream::app);
-		char starttime[SRT_BUF_SIZE];
-		char endtime[SRT_BUF_SIZE];
-
-		mtime_to_srttime(starttime, p_spu->i_start);
-		mtime_to_srttime(endtime, p_spu->i_stop);
+	ProcessSubtitleText(my_local_p_dec, subtitle_text, p_spu->i_start, p_spu->i_stop);
 
-		myfile << 1 << "\n" << starttime << " --> " << endtime << "\n" << FromWide(subtitle_text.c_str()) << "\n\n";
-
-		myfile.close();
-	}
 	// skip calling actual queue routine if don't want to render subtitle
 	if (p_sys->b_RenderEnable == true)
 	{
@@ -274,6 +430,36 @@ static int MyDecoderQueueSub(decoder_t *p_dec, subpicture_t * p_spu)
  * to chose.
  *****************************************************************************/
 
+// load config vars & init native decoder state
+static void InitDecoderSys(decoder_t *p_dec, decoder_sys_t *p_sys)
+{
+	p_sys->b_videofilterEnable = var_InheritBool(p_dec, "dvdsub-video-filter");
+	p_sys->b_audiofilterEnable = var_InheritBool(p_dec, "dvdsub-audio-filter");
+	p_sys->b_RenderEnable = var_InheritBool(p_dec, "dvdsub-render-enable");
+	p_sys->b_DumpTextToFileEnable = var_InheritBool(p_dec, "dvdsub-text-to-file-enable");
+	p_sys->b_CaptureTextPicsEnable = var_InheritBool(p_dec, "dvdsub-save-text-pic-enable");
+	p_sys->b_NativeDecodeEnable = var_InheritBool(p_dec, "dvdsub-native-decode");
+	p_sys->b_SingleFieldEnable = var_InheritBool(p_dec, "dvdsub-ocr-single-field");
+	p_sys->b_disabletrans = var_InheritBool(p_dec, "dvdsub-transparency");
+	p_sys->p_mute = NULL;
+	p_sys->i_mute_source = MUTE_SOURCE_SUBTITLE;
+	p_sys->b_OcrTiming = false;
+	p_sys->i_pts = VLC_TS_INVALID;
+	p_sys->i_spu_size = 0;
+	p_sys->i_rle_size = 0;
+	p_sys->i_spu = 0;
+	p_sys->p_block = NULL;
+	p_sys->rle_scratch.p_buffer = NULL;
+	p_sys->rle_scratch.i_size = 0;
+	p_sys->mask_scratch.p_buffer = NULL;
+	p_sys->mask_scratch.i_size = 0;
+	p_sys->i_scratch_allocs = 0;
+	p_sys->p_ocr_pool = NULL;
+	p_sys->i_subtitles = 0;
+	p_sys->b_last_text_valid = false;
+	p_sys->i_last_content_hash = 0;
+}
+
 static int DecoderOpen( vlc_object_t *p_this )
 {
     decoder_t     *p_dec = (decoder_t*)p_this;
@@ -281,11 +467,7 @@ static int DecoderOpen( vlc_object_t *p_this )
 	int spu_id = -1;
 
 	// load some config vars
-	p_sys->b_videofilterEnable = var_InheritBool(p_dec, "dvdsub-video-filter");
-	p_sys->b_audiofilterEnable = var_InheritBool(p_dec, "dvdsub-audio-filter");
-	p_sys->b_RenderEnable = var_InheritBool(p_dec, "dvdsub-render-enable");
-	p_sys->b_DumpTextToFileEnable = var_InheritBool(p_dec, "dvdsub-text-to-file-enable");
-	p_sys->b_CaptureTextPicsEnable = var_InheritBool(p_dec, "dvdsub-save-text-pic-enable");
+	InitDecoderSys(p_dec, p_sys);
 	spu_id = (var_GetInteger(p_dec->obj.parent, "spu-es") - SPU_ID_BASE);
 	// if filters not enabled, don't even both loading this module
 	if ((var_GetBool(p_dec->obj.parent, "Local_Enable_Filters") == false) || (p_sys->b_audiofilterEnable == false) || (spu_id != 0))
@@ -300,6 +482,36 @@ static int DecoderOpen( vlc_object_t *p_this )
 		vlc_obj_free((vlc_object_t *)p_dec, p_sys);
 		return VLC_ENOMEM;
 	}
+
+	// if demux is doing the ocr ahead of time (early ocr), just wrap the vlc decoder, so as to time the subtitles against it
+	if (var_InheritBool(p_dec, "dvdsub-early-ocr"))
+	{
+		p_sys->b_OcrTiming = true;
+		p_sys->b_NativeDecodeEnable = false;
+		p_sys->b_RenderEnable = true;
+	}
+
+	if (p_sys->b_NativeDecodeEnable)
+	{
+		// decode the spu packets here, no need for the vlc spudec module
+		if (p_dec->fmt_in.i_codec != VLC_CODEC_SPU)
+		{
+			vlc_obj_free((vlc_object_t *)p_dec, p_sys);
+			return VLC_EGENERIC;
+		}
+		p_sys->p_subdec = NULL;
+		p_dec->p_sys = p_sys;
+		p_dec->pf_decode = Decode;
+		p_dec->pf_packetize = NULL;
+		p_dec->fmt_out.i_codec = VLC_CODEC_SPU;
+
+		msg_Info(p_dec, "Subtitle dec: using native decoder \n");
+		WordListLoadStart(VLC_OBJECT(p_dec), false);
+		p_sys->p_mute = MuteScheduleGet(p_dec->obj.parent);
+
+		return VLC_SUCCESS;
+	}
+
 	p_sys->p_subdec = (decoder_t *)vlc_object_create(p_dec, sizeof(*p_dec));
 	if (p_sys->p_subdec == NULL)
 	{
@@ -333,9 +545,9 @@ static int DecoderOpen( vlc_object_t *p_this )
 	p_dec->fmt_out = p_sys->p_subdec->fmt_out;
 	p_dec->fmt_in = p_sys->p_subdec->fmt_in;
 
-	// TODO: change how word list gets in here?
-	msg_Info(p_dec, "\n\nLoading words file.\n\n");
-	LoadWords(p_dec);
+	// normally already loaded (or loading) since the demux opened
+	WordListLoadStart(VLC_OBJECT(p_dec), false);
+	p_sys->p_mute = MuteScheduleGet(p_dec->obj.parent);
 
     return VLC_SUCCESS;
 }
@@ -350,14 +562,23 @@ static void Close( vlc_object_t *p_this )
 
 	msg_Info(p_dec, "Subtitle dec: unloading module.... \n");
 
-	module_unneed(sys->p_subdec, sys->p_subdec->p_module);
-	sys->p_subdec->p_module = NULL;
-	vlc_object_release(sys->p_subdec);
+	if (sys->p_subdec != NULL)
+	{
+		module_unneed(sys->p_subdec, sys->p_subdec->p_module);
+		sys->p_subdec->p_module = NULL;
+		vlc_object_release(sys->p_subdec);
+	}
+	else
+	{
+		msg_Info(p_dec, "Subtitle dec: %u subtitles, %u scratch buffer allocations, %u ocr bitmap allocations \n",
+			sys->i_subtitles, sys->i_scratch_allocs, OcrBitmapAllocations(sys->p_ocr_pool));
+	}
+	block_ChainRelease(sys->p_block);
+	ReleaseScratch(sys);
+	MuteScheduleRelease(sys->p_mute);
 	vlc_obj_free((vlc_object_t *)p_dec, sys);
 
-	// filter cleanup stuff
-	badwords.clear();
-
+	// word list stays loaded for the rest of the movie, demux close empties it
 }
 
 /*****************************************************************************
@@ -366,7 +587,193 @@ static void Close( vlc_object_t *p_this )
 
 static int Decode( decoder_t *p_dec, block_t *p_block )
 {
-	return p_dec->p_sys->p_subdec->pf_decode(p_dec->p_sys->p_subdec, p_block);
+	decoder_sys_t *p_sys = p_dec->p_sys;
+	block_t       *p_spu_block;
+	subpicture_t  *p_spu;
+	mtime_t        i_start, i_stop;
+	int            i_ret;
+	std::wstring   subtitle_text = L"";
+
+	if (!p_sys->b_NativeDecodeEnable)
+	{
+		return p_sys->p_subdec->pf_decode(p_sys->p_subdec, p_block);
+	}
+
+	if (p_block == NULL) /* No Drain */
+		return VLCDEC_SUCCESS;
+
+	p_spu_block = Reassemble(p_dec, p_block);
+	if (!p_spu_block)
+	{
+		return VLCDEC_SUCCESS;
+	}
+
+	p_sys->i_spu = block_ChainExtract(p_spu_block, p_sys->buffer, 65536);
+	p_sys->i_pts = p_spu_block->i_pts;
+	block_ChainRelease(p_spu_block);
+
+	/* Parse, ocr and (if enabled) render */
+	i_ret = ParsePacket(p_dec, &subtitle_text, &i_start, &i_stop, &p_spu);
+
+	/* reinit context */
+	p_sys->i_spu_size = 0;
+	p_sys->i_rle_size = 0;
+	p_sys->i_spu = 0;
+	p_sys->p_block = NULL;
+
+	if (i_ret != VLC_SUCCESS)
+		return VLCDEC_SUCCESS;
+
+	ProcessSubtitleText(p_dec, subtitle_text, i_start, i_stop);
+
+	// only have a subpicture if rendering is enabled
+	if (p_spu != NULL)
+	{
+		decoder_QueueSub(p_dec, p_spu);
+	}
+	return VLCDEC_SUCCESS;
+}
+
+/*****************************************************************************
+ * Reassemble: collect the pes packets of one spu (same as vlc spudec)
+ *****************************************************************************/
+block_t *Reassemble( decoder_t *p_dec, block_t *p_block )
+{
+	decoder_sys_t *p_sys = p_dec->p_sys;
+
+	if (p_block->i_flags & BLOCK_FLAG_CORRUPTED)
+	{
+		block_Release(p_block);
+		return NULL;
+	}
+
+	if (p_sys->i_spu_size <= 0 &&
+		(p_block->i_pts <= VLC_TS_INVALID || p_block->i_buffer < 4))
+	{
+		msg_Dbg(p_dec, "invalid starting packet (size < 4 or pts <=0)");
+		block_Release(p_block);
+		return NULL;
+	}
+
+	block_ChainAppend(&p_sys->p_block, p_block);
+	p_sys->i_spu += p_block->i_buffer;
+
+	if (p_sys->i_spu_size <= 0)
+	{
+		p_sys->i_spu_size = (p_block->p_buffer[0] << 8) |
+			p_block->p_buffer[1];
+		p_sys->i_rle_size = ((p_block->p_buffer[2] << 8) |
+			p_block->p_buffer[3]) - 4;
+
+		if (p_sys->i_spu_size <= 0 || p_sys->i_rle_size >= p_sys->i_spu_size)
+		{
+			p_sys->i_spu_size = 0;
+			p_sys->i_rle_size = 0;
+			p_sys->i_spu = 0;
+			p_sys->p_block = NULL;
+
+			block_Release(p_block);
+			return NULL;
+		}
+	}
+
+	if (p_sys->i_spu >= p_sys->i_spu_size)
+	{
+		/* We have a complete sub */
+		if (p_sys->i_spu > p_sys->i_spu_size)
+			msg_Dbg(p_dec, "SPU packets size=%d should be %d",
+				p_sys->i_spu, p_sys->i_spu_size);
+
+		return p_sys->p_block;
+	}
+	return NULL;
+}
+
+/*****************************************************************************
+ * Early OCR: decoder context used by the demux to parse, ocr & check the
+ * subtitles as they are demuxed, instead of when the decoder gets them.
+ * Nothing is rendered, and p_input is the parent, so it finds the same
+ * mute schedule as the normal decoder, with an interval of its own.
+ *****************************************************************************/
+decoder_t * EarlyOcrCreate(vlc_object_t *p_input, const es_format_t *p_fmt)
+{
+	decoder_t *p_dec = (decoder_t *)vlc_object_create(p_input, sizeof(*p_dec));
+	if (p_dec == NULL)
+		return NULL;
+
+	decoder_sys_t *p_sys = (decoder_sys_t *)vlc_obj_malloc((vlc_object_t *)p_dec, sizeof(*p_sys));
+	if (unlikely(p_sys == NULL))
+	{
+		vlc_object_release(p_dec);
+		return NULL;
+	}
+	InitDecoderSys(p_dec, p_sys);
+	p_sys->p_subdec = NULL;
+	p_sys->b_NativeDecodeEnable = true;
+	p_sys->b_RenderEnable = false;
+	p_sys->p_mute = MuteScheduleGet(p_input);
+	p_sys->i_mute_source = MUTE_SOURCE_EARLY_OCR;
+	p_dec->p_sys = p_sys;
+
+	es_format_Copy(&p_dec->fmt_in, p_fmt);
+	es_format_Init(&p_dec->fmt_out, SPU_ES, VLC_CODEC_SPU);
+
+	WordListLoadStart(VLC_OBJECT(p_dec), false);
+	return p_dec;
 }
 
+// returns true, with the subtitle start time, each time a whole subtitle has been checked
+bool EarlyOcrDecode(decoder_t *p_dec, block_t *p_block, mtime_t *pi_start)
+{
+	decoder_sys_t *p_sys = p_dec->p_sys;
+	block_t       *p_spu_block;
+	subpicture_t  *p_spu;
+	mtime_t        i_stop;
+	mtime_t        i_ocr_start;
+	int            i_ret;
+	std::wstring   subtitle_text = L"";
+
+	p_spu_block = Reassemble(p_dec, p_block);
+	if (!p_spu_block)
+		return false;
+
+	p_sys->i_spu = block_ChainExtract(p_spu_block, p_sys->buffer, 65536);
+	p_sys->i_pts = p_spu_block->i_pts;
+	block_ChainRelease(p_spu_block);
+
+	i_ocr_start = mdate();
+	i_ret = ParsePacket(p_dec, &subtitle_text, pi_start, &i_stop, &p_spu);
+
+	/* reinit context */
+	p_sys->i_spu_size = 0;
+	p_sys->i_rle_size = 0;
+	p_sys->i_spu = 0;
+	p_sys->p_block = NULL;
+
+	if (i_ret != VLC_SUCCESS)
+		return false;
+
+	ProcessSubtitleText(p_dec, subtitle_text, *pi_start, i_stop);
+	if (p_sys->p_mute != NULL)
+	{
+		mtime_t i_now = mdate();
+		MuteScheduleOcrNote(p_sys->p_mute, MUTE_SOURCE_EARLY_OCR, *pi_start, i_now, i_now - i_ocr_start);
+	}
+	return true;
+}
 
+void EarlyOcrDestroy(decoder_t *p_dec)
+{
+	if (p_dec == NULL)
+		return;
+
+	decoder_sys_t *p_sys = p_dec->p_sys;
+	msg_Info(p_dec, "Early ocr: %u subtitles, %u scratch buffer allocations, %u ocr bitmap allocations \n",
+		p_sys->i_subtitles, p_sys->i_scratch_allocs, OcrBitmapAllocations(p_sys->p_ocr_pool));
+	block_ChainRelease(p_sys->p_block);
+	ReleaseScratch(p_sys);
+	MuteScheduleRelease(p_sys->p_mute);
+	es_format_Clean(&p_dec->fmt_in);
+	es_format_Clean(&p_dec->fmt_out);
+	vlc_object_release(p_dec);
+}
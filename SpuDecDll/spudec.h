@@ -27,6 +27,7 @@
 #define restrict __restrict
 #include <vlc_charset.h>
 #undef restrict
+#include <vlc_codec.h>
 
 // windows header files
 #include <iostream>
@@ -42,7 +43,142 @@ using namespace std;
  *****************************************************************************/
 #define SPU_ID_BASE 0xbd20
 
+#define SPU_CMD_FORCE_DISPLAY       0x00
+#define SPU_CMD_START_DISPLAY       0x01
+#define SPU_CMD_STOP_DISPLAY        0x02
+#define SPU_CMD_SET_PALETTE         0x03
+#define SPU_CMD_SET_ALPHACHANNEL    0x04
+#define SPU_CMD_SET_COORDINATES     0x05
+#define SPU_CMD_SET_OFFSETS         0x06
+#define SPU_CMD_END                 0xff
+
+#define SPU_RLE_PEEK_PADDING        8
+
+#include "MuteSchedule.h"
+
+// growable buffer owned by the decoder, reused from one subtitle to the next
+typedef struct
+{
+	uint8_t *p_buffer;
+	size_t   i_size;
+} spu_scratch_t;
+
+// ocr staging bitmaps, one pool per decoder (ocrdec.cpp)
+typedef struct ocr_bitmap_pool_t ocr_bitmap_pool_t;
+
+struct decoder_sys_t
+{
+	decoder_t * p_subdec;
+
+	//new
+	bool b_videofilterEnable;
+	bool b_audiofilterEnable;
+	bool b_RenderEnable;
+	bool b_DumpTextToFileEnable;
+	bool b_CaptureTextPicsEnable;
+	bool b_NativeDecodeEnable;
+	bool b_SingleFieldEnable;
+
+	// where mutes for found words go (NULL if the demux isn't filtering), & which queue is ours
+	mute_schedule_t *p_mute;
+	mute_source_t i_mute_source;
+
+	// early ocr is checking the subtitles: decode & render them like vlc, only noting when each one arrives
+	bool b_OcrTiming;
+
+	// native spu decoder state (only used when b_NativeDecodeEnable), same as vlc spudec
+	bool          b_disabletrans;
+	mtime_t       i_pts;
+	unsigned int  i_spu_size;
+	unsigned int  i_rle_size;
+	unsigned int  i_spu;
+	block_t      *p_block;
+
+	/* We will never overflow, the padding lets the rle reader peek 16 bits past the last code */
+	uint8_t       buffer[65536 + SPU_RLE_PEEK_PADDING];
+
+	// reused for every subtitle: expanded rle codes and ocr mask
+	spu_scratch_t rle_scratch;
+	spu_scratch_t mask_scratch;
+	unsigned int  i_scratch_allocs;
+	ocr_bitmap_pool_t *p_ocr_pool;      // made on first use
+	unsigned int  i_subtitles;
+
+	// text of the last subtitle, reused when the next one has the same content hash
+	bool          b_last_text_valid;
+	uint64_t      i_last_content_hash;
+	wchar_t       psz_last_text[512];
+
+	// i think problems having this in here due to dynamic size
+	//std::vector<std::wstring> badwords;
+};
+
+typedef struct
+{
+	int   pi_offset[2];                              /* byte offsets to data */
+	uint16_t *p_data;
+
+	/* Color information */
+	bool b_palette;
+	uint8_t    pi_alpha[4];
+	uint8_t    pi_yuv[4][3];
+
+	/* Auto crop fullscreen subtitles */
+	bool b_auto_crop;
+	int i_y_top_offset;
+	int i_y_bottom_offset;
+
+	/* Color index most likely used for the text itself (-1 if none) */
+	int i_text_color;
+
+	/* Opaque area, as the number of transparent columns/lines on each edge,
+	 * and a hash of the picture; all worked out from the rle codes.
+	 * If nothing is opaque, crop left/top are the full width/height. */
+	int i_crop_left;
+	int i_crop_right;
+	int i_crop_top;
+	int i_crop_bottom;
+	uint64_t i_content_hash;
+
+	/* 2 if only the even field was decoded (half height), else 1 */
+	int i_y_scale;
+
+} subpicture_data_t;
+
+typedef struct
+{
+	int i_width;
+	int i_height;
+	int i_x;
+	int i_y;
+} spu_properties_t;
+
+// OCR mask: 1 byte per pixel, with bit (1 << color index) set for every pixel that is not transparent
+// this lets the ocr stage pick which color(s) to treat as text without going through a rendered yuvp region
+#define SPU_OCR_MASK_BIT(i_color) ((uint8_t)(1 << (i_color)))
+
 wchar_t * OcrDecodeText(subpicture_region_t * SpuProp, bool SavePicToFile);
+wchar_t * OcrDecodeMask(ocr_bitmap_pool_t * p_pool, const uint8_t * p_mask, int i_width, int i_height, int i_y_scale, int i_text_color, bool SavePicToFile);
+ocr_bitmap_pool_t * OcrBitmapPoolNew(void);
+void OcrBitmapPoolDelete(ocr_bitmap_pool_t * p_pool);
+unsigned int OcrBitmapAllocations(const ocr_bitmap_pool_t * p_pool);
+
+// native spu decoder (parse.c)
+block_t * Reassemble(decoder_t *p_dec, block_t *p_block);
+int ParsePacket(decoder_t *p_dec, std::wstring *subtitle_text,
+	mtime_t *pi_start, mtime_t *pi_stop, subpicture_t **pp_spu);
+void ReleaseScratch(decoder_sys_t *p_sys);
+
+// spu decoder (spudec.c)
+void ProcessSubtitleText(decoder_t *p_dec, std::wstring &subtitle_text, mtime_t i_start, mtime_t i_stop);
+
+// early ocr, run from the demux (spudec.c)
+decoder_t * EarlyOcrCreate(vlc_object_t *p_input, const es_format_t *p_fmt);
+bool EarlyOcrDecode(decoder_t *p_dec, block_t *p_block, mtime_t *pi_start);
+void EarlyOcrDestroy(decoder_t *p_dec);
+
+void WordListLoadStart(vlc_object_t *p_obj, bool b_reload);
+void WordListRelease(void);
 
 #define SRT_BUF_SIZE 50
 // note, srttimebuf must be passed in with size SRT_BUF_SIZE; todo: perhaps better way to pass in buffer?
@@ -58,20 +194,3 @@ static inline void mtime_to_srttime(char srttimebuf[SRT_BUF_SIZE], mtime_t itime
 	n = sprintf_s(srttimebuf, SRT_BUF_SIZE, "%02d:%02d:%02d,%03d", hours, minutes, seconds, milliseconds);
 }
 
-static inline void srttime_to_mtime(mtime_t &itime, std::wstring srttime)
-{
-	// format of srttime is:  hh:mm:ss,ms. <== 3 digits of ms
-	// might be a better way of doing this... but, for now... just change : and , to space to help with parsing
-	srttime[2] = ' ';
-	srttime[5] = ' ';
-	srttime[8] = ' ';
-	std::wstringstream iss(srttime);
-	unsigned int hours;
-	unsigned int minutes;
-	unsigned int seconds;
-	unsigned int milliseconds;
-	if (!(iss >> hours >> minutes >> seconds >> milliseconds)) { return; } // error
-	// stuff below doing reverse of calculations in mtime_to_srttime
-	itime = ((((((hours * 60) + minutes) * 60) + seconds) * 1000) + milliseconds) * 1000ULL;
-
-}